@@ -86,6 +86,7 @@ const struct m_sub_options encode_config = {
         {"ocopy-metadata", OPT_BOOL(copy_metadata)},
         {"oset-metadata", OPT_KEYVALUELIST(set_metadata)},
         {"oremove-metadata", OPT_STRINGLIST(remove_metadata)},
+        {"orenditions", OPT_STRINGLIST(renditions)},
         {0}
     },
     .size = sizeof(struct encode_opts),
@@ -94,14 +95,17 @@ const struct m_sub_options encode_config = {
     },
 };
 
-struct encode_lavc_context *encode_lavc_init(struct mpv_global *global)
+// Takes ownership of options.
+static struct encode_lavc_context *encode_lavc_create(struct mpv_global *global,
+                                                      struct encode_opts *options,
+                                                      struct mp_log *log)
 {
     struct encode_lavc_context *ctx = talloc_ptrtype(NULL, ctx);
     *ctx = (struct encode_lavc_context){
         .global = global,
-        .options = mp_get_config_group(ctx, global, &encode_config),
+        .options = talloc_steal(ctx, options),
         .priv = talloc_zero(ctx, struct encode_priv),
-        .log = mp_log_new(ctx, global->log, "encode"),
+        .log = talloc_steal(ctx, log),
     };
     mp_mutex_init(&ctx->lock);
 
@@ -147,6 +151,47 @@ fail:
     return NULL;
 }
 
+struct encode_lavc_context *encode_lavc_init(struct mpv_global *global)
+{
+    return encode_lavc_create(global,
+                              mp_get_config_group(NULL, global, &encode_config),
+                              mp_log_new(NULL, global->log, "encode"));
+}
+
+struct encode_lavc_context *encode_lavc_init_rendition(
+    struct encode_lavc_context *ctx, const char *file, char **vopts)
+{
+    struct encode_opts *opts = talloc_ptrtype(NULL, opts);
+    *opts = *ctx->options;
+    opts->file = talloc_strdup(opts, file);
+    opts->acodec = NULL;
+    opts->aopts = NULL;
+    opts->renditions = NULL;
+
+    // Append to a copy of --ovcopts.
+    opts->vopts = NULL;
+    int num_vopts = 0;
+    for (int n = 0; ctx->options->vopts && ctx->options->vopts[n]; n++)
+        MP_TARRAY_APPEND(opts, opts->vopts, num_vopts, ctx->options->vopts[n]);
+    for (int n = 0; vopts && vopts[n]; n++)
+        MP_TARRAY_APPEND(opts, opts->vopts, num_vopts, vopts[n]);
+    MP_TARRAY_APPEND(opts, opts->vopts, num_vopts, NULL);
+
+    struct mp_log *log = mp_log_new(NULL, ctx->log, "rendition");
+    struct encode_lavc_context *rctx = encode_lavc_create(ctx->global, opts, log);
+    if (!rctx)
+        return NULL;
+
+    mp_mutex_lock(&ctx->lock);
+    struct mp_tags *metadata = ctx->priv->metadata;
+    if (metadata)
+        rctx->priv->metadata = mp_tags_dup(rctx, metadata);
+    mp_mutex_unlock(&ctx->lock);
+
+    encode_lavc_expect_stream(rctx, STREAM_VIDEO);
+    return rctx;
+}
+
 void encode_lavc_set_metadata(struct encode_lavc_context *ctx,
                               struct mp_tags *metadata)
 {
@@ -107,4 +107,10 @@ AVRational encoder_get_mux_timebase_unlocked(struct encoder_context *p);
 
 void encoder_update_log(struct mpv_global *global);
 
+// Create a separate muxer that writes a single video stream to file, encoded
+// with the same settings as ctx, but with vopts appended to --ovcopts. ctx must
+// outlive the returned context. Free with encode_lavc_free().
+struct encode_lavc_context *encode_lavc_init_rendition(
+    struct encode_lavc_context *ctx, const char *file, char **vopts);
+
 #endif
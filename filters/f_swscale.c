@@ -148,6 +148,10 @@ struct mp_sws_filter *mp_sws_filter_create(struct mp_filter *parent)
     s->sws->log = f->log;
     mp_sws_enable_cmdline_opts(s->sws, f->global);
     s->pool = mp_image_pool_new(s);
+    // Keep a few images of the previous output size when the video or filter
+    // parameters change, instead of dropping all of them each time.
+    mp_image_pool_set_max_free(s->pool, 2);
+    mp_image_pool_set_stats(s->pool, f->global, "swscale");
 
     return s;
 }
@@ -248,7 +248,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 5)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 7)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1227,6 +1227,41 @@ MPV_EXPORT int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 MPV_EXPORT int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
                                     const char *name, mpv_format format);
 
+/**
+ * Like mpv_observe_property() with MPV_FORMAT_NODE, but report changes to
+ * list properties as differences to the previously reported value. This is
+ * meant for properties like "playlist" or "track-list", which can become
+ * large, while most changes touch only a few entries.
+ *
+ * The data of MPV_EVENT_PROPERTY_CHANGE is always a MPV_FORMAT_NODE_MAP with
+ * one of these entries:
+ *
+ *  "value"     The full property value. This is sent with the first change
+ *              event, the first event after the property was unavailable, and
+ *              whenever the value is not a list of entries with unique "id"
+ *              fields (plus "type" fields, if present), or a list of changes
+ *              would not be shorter than the new list.
+ *  "changes"   A MPV_FORMAT_NODE_ARRAY of operations turning the previously
+ *              reported list into the new list. They have to be applied in
+ *              order; each index refers to the list as left by the previous
+ *              operation. Each operation is a MPV_FORMAT_NODE_MAP with:
+ *
+ *              "op"    "remove", "insert", "move" or "change"
+ *              "index" index of the removed, inserted or changed entry, or
+ *                      the destination index of a moved entry
+ *              "from"  source index of a moved entry (the entry is removed
+ *                      there first, then inserted at "index")
+ *              "value" the new entry ("insert" and "change" only)
+ *
+ * Safe to be called from mpv render API threads.
+ *
+ * @param reply_userdata see mpv_observe_property()
+ * @param name The property name.
+ * @return error code
+ */
+MPV_EXPORT int mpv_observe_property_diff(mpv_handle *mpv, uint64_t reply_userdata,
+                                         const char *name);
+
 /**
  * Undo mpv_observe_property(). This will remove all observed properties for
  * which the given number was passed as reply_userdata to mpv_observe_property.
@@ -1691,6 +1726,8 @@ MPV_EXPORT int mpv_request_log_messages(mpv_handle *ctx, const char *min_level);
  * don't empty the event queue quickly enough with mpv_wait_event(), it will
  * overflow and silently discard further events. If this happens, making
  * asynchronous requests will fail as well (with MPV_ERROR_EVENT_QUEUE_FULL).
+ * The queue size can be changed with mpv_set_event_queue_size(), and overflows
+ * can be monitored with mpv_get_event_queue_stats().
  *
  * Only one thread is allowed to call this on the same mpv_handle at a time.
  * The API won't complain if more than one thread calls this, but it will cause
@@ -1715,6 +1752,59 @@ MPV_EXPORT int mpv_request_log_messages(mpv_handle *ctx, const char *min_level);
  */
 MPV_EXPORT mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout);
 
+/**
+ * Like mpv_wait_event(), but return up to max_events events at once. This
+ * waits until at least one event is available (or the timeout expires), and
+ * then returns all events that are immediately available, up to max_events.
+ * This is cheaper than calling mpv_wait_event() for each event when handling
+ * bursts of events.
+ *
+ * The same restrictions as with mpv_wait_event() apply. Calling either
+ * function releases the events returned by the previous call.
+ *
+ * @param events Set to an array of the returned events. The array and all
+ *               memory referenced by it stay valid until the next
+ *               mpv_wait_event() or mpv_wait_events() call, or until the
+ *               mpv_handle is destroyed. You must not write to it.
+ * @param max_events Maximum number of events to return. Must be at least 1.
+ * @param timeout see mpv_wait_event()
+ * @return Number of returned events, 0 on timeout or wakeup by mpv_wakeup(),
+ *         or an error code.
+ */
+MPV_EXPORT int mpv_wait_events(mpv_handle *ctx, mpv_event **events,
+                               int max_events, double timeout);
+
+/**
+ * Set the maximum number of events the event queue of this mpv_handle can
+ * hold (see mpv_wait_event()). The default is 1000.
+ *
+ * @param num_events New queue size. Must be at least 1.
+ * @return error code; MPV_ERROR_EVENT_QUEUE_FULL if more events are currently
+ *         queued (or reserved for replies to asynchronous requests) than fit
+ *         into the new size.
+ */
+MPV_EXPORT int mpv_set_event_queue_size(mpv_handle *ctx, int num_events);
+
+/**
+ * Return statistics about the event queue of this mpv_handle as a
+ * MPV_FORMAT_NODE_MAP with the following entries:
+ *
+ *  "queued"        number of currently queued events (MPV_FORMAT_INT64)
+ *  "queue-size"    maximum number of queued events (MPV_FORMAT_INT64)
+ *  "choked"        whether the queue overflowed, and events are discarded
+ *                  until the queue is emptied (MPV_FORMAT_FLAG)
+ *  "overflows"     how often the queue overflowed (MPV_FORMAT_INT64)
+ *  "dropped"       total number of discarded events (MPV_FORMAT_INT64)
+ *
+ * Property change and log message events are not queued, and thus are not
+ * included. More entries may be added in the future.
+ *
+ * @param stats Set to the statistics. Must be freed with
+ *              mpv_free_node_contents().
+ * @return error code
+ */
+MPV_EXPORT int mpv_get_event_queue_stats(mpv_handle *ctx, mpv_node *stats);
+
 /**
  * Interrupt the current mpv_wait_event() call. This will wake up the thread
  * currently waiting in mpv_wait_event(). If no thread is waiting, the next
@@ -1998,6 +2088,8 @@ MPV_DEFINE_SYM_PTR(mpv_get_property_async)
 #define mpv_get_property_async pfn_mpv_get_property_async
 MPV_DEFINE_SYM_PTR(mpv_observe_property)
 #define mpv_observe_property pfn_mpv_observe_property
+MPV_DEFINE_SYM_PTR(mpv_observe_property_diff)
+#define mpv_observe_property_diff pfn_mpv_observe_property_diff
 MPV_DEFINE_SYM_PTR(mpv_unobserve_property)
 #define mpv_unobserve_property pfn_mpv_unobserve_property
 MPV_DEFINE_SYM_PTR(mpv_event_name)
@@ -2010,6 +2102,12 @@ MPV_DEFINE_SYM_PTR(mpv_request_log_messages)
 #define mpv_request_log_messages pfn_mpv_request_log_messages
 MPV_DEFINE_SYM_PTR(mpv_wait_event)
 #define mpv_wait_event pfn_mpv_wait_event
+MPV_DEFINE_SYM_PTR(mpv_wait_events)
+#define mpv_wait_events pfn_mpv_wait_events
+MPV_DEFINE_SYM_PTR(mpv_set_event_queue_size)
+#define mpv_set_event_queue_size pfn_mpv_set_event_queue_size
+MPV_DEFINE_SYM_PTR(mpv_get_event_queue_stats)
+#define mpv_get_event_queue_stats pfn_mpv_get_event_queue_stats
 MPV_DEFINE_SYM_PTR(mpv_wakeup)
 #define mpv_wakeup pfn_mpv_wakeup
 MPV_DEFINE_SYM_PTR(mpv_set_wakeup_callback)
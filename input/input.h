@@ -264,13 +264,28 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
                               int out_fd[2]);
 void mp_uninit_ipc(struct mp_ipc_ctx *ctx);
 
-// Serialize the given mpv_event structure to JSON. Returns an allocated string.
+// Message format of an IPC connection. Clients start with JSON, and can switch
+// with the "set_ipc_format" command.
+enum mp_ipc_format {
+    MP_IPC_JSON,
+    MP_IPC_MSGPACK,     // length-prefixed MessagePack frames
+};
+
+// Serialize the given mpv_event structure in the given format. Returns an
+// allocated buffer.
 struct mpv_event;
-char *mp_json_encode_event(struct mpv_event *event);
+bstr mp_ipc_encode_event(void *ta_parent, struct mpv_event *event,
+                         enum mp_ipc_format format);
+
+// Whether the raw IPC input buffer "buf" contains a complete command.
+bool mp_ipc_has_command(bstr buf, enum mp_ipc_format format);
 
-// Given the raw IPC input buffer "buf", remove the first newline-separated
-// command, execute it and return the result (if any) as an allocated string.
+// Given the raw IPC input buffer "buf", remove the first command (a line for
+// JSON, a frame for MessagePack), execute it and return the result (if any) as
+// an allocated buffer. If the command switches the format, *format is updated;
+// the reply still uses the old format.
 struct mpv_handle;
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
+bstr mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf,
+                                 enum mp_ipc_format *format);
 
 #endif /* MPLAYER_INPUT_H */
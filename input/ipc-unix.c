@@ -25,6 +25,10 @@
 #include <sys/stat.h>
 #include <sys/un.h>
 
+#if HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include "osdep/io.h"
 #include "osdep/threads.h"
 
@@ -46,6 +50,7 @@ struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const char *path;
+    bool single_thread;
 
     mp_thread thread;
     int death_pipe[2];
@@ -61,13 +66,15 @@ struct client_arg {
     bool quit_on_close;
 
     bool writable;
+    enum mp_ipc_format format;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static int ipc_write(struct client_arg *client, bstr buf)
 {
-    size_t count = strlen(buf);
+    size_t count = buf.len;
+    unsigned char *data = buf.start;
     while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
+        ssize_t rc = send(client->client_fd, data, count, MSG_NOSIGNAL);
         if (rc <= 0) {
             if (rc == 0)
                 return -1;
@@ -84,7 +91,7 @@ static int ipc_write_str(struct client_arg *client, const char *buf)
         }
 
         count -= rc;
-        buf   += rc;
+        data  += rc;
     }
 
     return 0;
@@ -145,14 +152,15 @@ static MP_THREAD_VOID client_thread(void *p)
                 if (!arg->writable)
                     continue;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
+                bstr event_msg = mp_ipc_encode_event(NULL, event, arg->format);
+                if (!event_msg.len) {
                     MP_ERR(arg, "Encoding error\n");
+                    talloc_free(event_msg.start);
                     goto done;
                 }
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
+                rc = ipc_write(arg, event_msg);
+                talloc_free(event_msg.start);
                 if (rc < 0) {
                     MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
                     goto done;
@@ -183,20 +191,20 @@ static MP_THREAD_VOID client_thread(void *p)
 
                 bstr_xappend(NULL, &client_msg, append);
 
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
+                while (mp_ipc_has_command(client_msg, arg->format)) {
+                    bstr reply_msg = mp_ipc_consume_next_command(arg->client,
+                        NULL, &client_msg, &arg->format);
 
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
+                    if (reply_msg.len && arg->writable) {
+                        rc = ipc_write(arg, reply_msg);
                         if (rc < 0) {
                             MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
+                            talloc_free(reply_msg.start);
                             goto done;
                         }
                     }
 
-                    talloc_free(reply_msg);
+                    talloc_free(reply_msg.start);
                 }
             }
         }
@@ -293,23 +301,14 @@ bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
     return true;
 }
 
-static MP_THREAD_VOID ipc_thread(void *p)
+static int ipc_listen(struct mp_ipc_ctx *arg)
 {
-    int rc;
-
-    int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mp_thread_set_name("ipc/socket");
-
-    MP_VERBOSE(arg, "Starting IPC master\n");
-
-    ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        return -1;
     }
 
     fchmod(ipc_fd, 0600);
@@ -317,7 +316,7 @@ static MP_THREAD_VOID ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -331,19 +330,395 @@ static MP_THREAD_VOID ipc_thread(void *p)
     }
 
     size_t addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + path_len;
-    rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
+    int rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
+    return ipc_fd;
+
+error:
+    close(ipc_fd);
+    return -1;
+}
+
+#if HAVE_EPOLL
+
+// Stop reading commands and events from a client once this much output is
+// queued, and continue after it has been written.
+#define LOOP_MAX_PENDING (1 << 20)
+
+// Number of events fetched from a client handle at once.
+#define LOOP_EVENT_BATCH 64
+
+enum loop_source_type {
+    SOURCE_DEATH_PIPE,
+    SOURCE_LISTEN,
+    SOURCE_SOCKET,
+    SOURCE_WAKEUP_PIPE,
+};
+
+// epoll_event.data.ptr points to this.
+struct loop_source {
+    enum loop_source_type type;
+    struct loop_client *client;
+};
+
+struct loop_client {
+    struct mp_log *log;
+    struct mpv_handle *client;
+    int fd;
+    int pipe_fd;
+    struct loop_source socket_src;
+    struct loop_source pipe_src;
+
+    bstr in;            // incomplete command
+    bstr out;           // queued output; out.start[out_pos..] is unwritten
+    size_t out_pos;
+    enum mp_ipc_format format;
+    bool paused;        // stopped reading because of queued output
+    bool dead;          // remove after current epoll_wait() results
+};
+
+struct ipc_loop {
+    struct mp_log *log;
+    struct mp_client_api *client_api;
+    int epoll_fd;
+    int listen_fd;          // -1 once the server was stopped
+    int client_num;
+    struct loop_client **clients;
+    int num_clients;
+};
+
+// Register the fds of a client for the events it currently can handle.
+static void loop_update_client(struct ipc_loop *loop, struct loop_client *c)
+{
+    struct epoll_event ev = {.data.ptr = &c->socket_src};
+    if (!c->paused)
+        ev.events |= EPOLLIN;
+    if (c->out.len > c->out_pos)
+        ev.events |= EPOLLOUT;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+
+    ev = (struct epoll_event){
+        .events = c->paused ? 0 : EPOLLIN,
+        .data.ptr = &c->pipe_src,
+    };
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, c->pipe_fd, &ev);
+}
+
+// Write as much queued output as possible without blocking.
+static void loop_flush_client(struct loop_client *c)
+{
+    while (c->out.len > c->out_pos) {
+        ssize_t rc = send(c->fd, c->out.start + c->out_pos,
+                          c->out.len - c->out_pos, MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            MP_ERR(c, "Write error (%s)\n", mp_strerror(errno));
+            c->dead = true;
+            return;
+        }
+        c->out_pos += rc;
+    }
+
+    if (c->out_pos == c->out.len) {
+        c->out.len = c->out_pos = 0;
+    } else if (c->out_pos >= LOOP_MAX_PENDING / 2) {
+        memmove(c->out.start, c->out.start + c->out_pos, c->out.len - c->out_pos);
+        c->out.len -= c->out_pos;
+        c->out_pos = 0;
+    }
+}
+
+static void loop_queue_output(struct loop_client *c, bstr msg)
+{
+    bstr_xappend(c, &c->out, msg);
+    talloc_free(msg.start);
+    if (c->out.len - c->out_pos >= LOOP_MAX_PENDING)
+        loop_flush_client(c);
+    if (c->out.len - c->out_pos >= LOOP_MAX_PENDING)
+        c->paused = true;
+}
+
+static void loop_read_events(struct loop_client *c)
+{
+    while (!c->paused && !c->dead) {
+        mpv_event *events;
+        int num = mpv_wait_events(c->client, &events, LOOP_EVENT_BATCH, 0);
+        if (num <= 0)
+            break;
+
+        for (int n = 0; n < num; n++) {
+            if (events[n].event_id == MPV_EVENT_SHUTDOWN) {
+                c->dead = true;
+                return;
+            }
+
+            bstr event_msg = mp_ipc_encode_event(NULL, &events[n], c->format);
+            if (!event_msg.len) {
+                MP_ERR(c, "Encoding error\n");
+                talloc_free(event_msg.start);
+                c->dead = true;
+                return;
+            }
+            loop_queue_output(c, event_msg);
+        }
+    }
+}
+
+static void loop_read_commands(struct loop_client *c)
+{
+    while (!c->paused && !c->dead) {
+        while (!c->paused && mp_ipc_has_command(c->in, c->format)) {
+            bstr reply_msg = mp_ipc_consume_next_command(c->client, NULL,
+                                                         &c->in, &c->format);
+            loop_queue_output(c, reply_msg);
+        }
+        if (c->paused)
+            break;
+
+        char buf[4096];
+        ssize_t bytes = read(c->fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                MP_ERR(c, "Read error (%s)\n", mp_strerror(errno));
+                c->dead = true;
+            }
+            return;
+        }
+
+        if (bytes == 0) {
+            MP_VERBOSE(c, "Client disconnected\n");
+            c->dead = true;
+            return;
+        }
+
+        bstr_xappend(c, &c->in, (bstr){buf, bytes});
+    }
+}
+
+// Write queued output, resume reading once most of it was written, and update
+// the epoll registration accordingly.
+static void loop_service_client(struct ipc_loop *loop, struct loop_client *c)
+{
+    loop_flush_client(c);
+    if (c->paused && !c->dead && c->out.len - c->out_pos < LOOP_MAX_PENDING / 2) {
+        // Events and commands may have been left unread when pausing.
+        c->paused = false;
+        loop_read_events(c);
+        loop_read_commands(c);
+        loop_flush_client(c);
+    }
+    if (!c->dead)
+        loop_update_client(loop, c);
+}
+
+static void loop_add_client(struct ipc_loop *loop, int fd)
+{
+    char *name = talloc_asprintf(NULL, "ipc-%d", loop->client_num++);
+    struct mpv_handle *h = mp_new_client(loop->client_api, name);
+    talloc_free(name);
+    if (!h) {
+        close(fd);
+        return;
+    }
+
+    struct loop_client *c = talloc_ptrtype(NULL, c);
+    *c = (struct loop_client){
+        .log = mp_client_get_log(h),
+        .client = h,
+        .fd = fd,
+        .pipe_fd = mpv_get_wakeup_pipe(h),
+        .socket_src = {SOURCE_SOCKET, c},
+        .pipe_src = {SOURCE_WAKEUP_PIPE, c},
+    };
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct epoll_event sev = {.events = EPOLLIN, .data.ptr = &c->socket_src};
+    struct epoll_event pev = {.events = EPOLLIN, .data.ptr = &c->pipe_src};
+    if (c->pipe_fd < 0 ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &sev) < 0 ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, c->pipe_fd, &pev) < 0)
+    {
+        MP_ERR(c, "Could not add client to event loop\n");
+        close(fd);
+        mpv_destroy(h);
+        talloc_free(c);
+        return;
+    }
+
+    MP_VERBOSE(c, "Client connected\n");
+    MP_TARRAY_APPEND(loop, loop->clients, loop->num_clients, c);
+}
+
+static void loop_destroy_client(struct ipc_loop *loop, struct loop_client *c)
+{
+    if (c->in.len > 0)
+        MP_WARN(c, "Ignoring unterminated command on disconnect.\n");
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, c->pipe_fd, NULL);
+    close(c->fd);
+    mpv_destroy(c->client);
+    // mp_ipc_consume_next_command() reallocates it without a parent.
+    talloc_free(c->in.start);
+    talloc_free(c);
+}
+
+// Serve clients until the death pipe is signaled. Once the server was stopped
+// (listen_fd < 0), serve the remaining clients until they are gone.
+static void loop_run(struct ipc_loop *loop)
+{
+    while (loop->listen_fd >= 0 || loop->num_clients) {
+        struct epoll_event events[64];
+        int num = epoll_wait(loop->epoll_fd, events, MP_ARRAY_SIZE(events), -1);
+        if (num < 0) {
+            if (errno != EINTR)
+                MP_ERR(loop, "Poll error\n");
+            continue;
+        }
+
+        for (int n = 0; n < num; n++) {
+            struct loop_source *src = events[n].data.ptr;
+            struct loop_client *c = src->client;
+            uint32_t revents = events[n].events;
+
+            switch (src->type) {
+            case SOURCE_DEATH_PIPE:
+                return;
+            case SOURCE_LISTEN: {
+                int client_fd = accept(loop->listen_fd, NULL, NULL);
+                if (client_fd < 0) {
+                    MP_ERR(loop, "Could not accept IPC client\n");
+                    return;
+                }
+                loop_add_client(loop, client_fd);
+                break;
+            }
+            case SOURCE_WAKEUP_PIPE:
+                if (c->dead)
+                    break;
+                mp_flush_wakeup_pipe(c->pipe_fd);
+                loop_read_events(c);
+                break;
+            case SOURCE_SOCKET:
+                if (c->dead)
+                    break;
+                // EPOLLOUT is handled by loop_service_client().
+                if (revents & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    loop_read_commands(c);
+                break;
+            }
+
+            if (c && !c->dead)
+                loop_service_client(loop, c);
+        }
+
+        for (int n = loop->num_clients - 1; n >= 0; n--) {
+            if (loop->clients[n]->dead) {
+                loop_destroy_client(loop, loop->clients[n]);
+                MP_TARRAY_REMOVE_AT(loop->clients, loop->num_clients, n);
+            }
+        }
+    }
+}
+
+static void loop_destroy(struct ipc_loop *loop)
+{
+    for (int n = 0; n < loop->num_clients; n++)
+        loop_destroy_client(loop, loop->clients[n]);
+    if (loop->epoll_fd >= 0)
+        close(loop->epoll_fd);
+    talloc_free(loop);
+}
+
+static MP_THREAD_VOID loop_thread(void *p)
+{
+    struct ipc_loop *loop = p;
+
+    mp_thread_set_name("ipc/clients");
+
+    loop_run(loop);
+    loop_destroy(loop);
+
+    MP_THREAD_RETURN();
+}
+
+// Serve all clients connected to ipc_fd from this thread.
+static void ipc_loop(struct mp_ipc_ctx *arg, int ipc_fd)
+{
+    struct ipc_loop *loop = talloc_ptrtype(NULL, loop);
+    *loop = (struct ipc_loop){
+        .log = mp_log_new(loop, arg->log, NULL),
+        .client_api = arg->client_api,
+        .epoll_fd = epoll_create1(EPOLL_CLOEXEC),
+        .listen_fd = ipc_fd,
+    };
+
+    struct loop_source death_src = {SOURCE_DEATH_PIPE};
+    struct loop_source listen_src = {SOURCE_LISTEN};
+    struct epoll_event dev = {.events = EPOLLIN, .data.ptr = &death_src};
+    struct epoll_event lev = {.events = EPOLLIN, .data.ptr = &listen_src};
+    if (loop->epoll_fd < 0 ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, arg->death_pipe[0], &dev) < 0 ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, ipc_fd, &lev) < 0)
+    {
+        MP_ERR(arg, "Could not create event loop\n");
+        loop_destroy(loop);
+        return;
+    }
+
+    loop_run(loop);
+
+    // Like with the per-client threads, connected clients outlive the server.
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, arg->death_pipe[0], NULL);
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, ipc_fd, NULL);
+    loop->listen_fd = -1;
+
+    mp_thread thread;
+    if (loop->num_clients && !mp_thread_create(&thread, loop_thread, loop)) {
+        mp_thread_detach(thread);
+        return;
+    }
+    loop_destroy(loop);
+}
+
+#endif
+
+static MP_THREAD_VOID ipc_thread(void *p)
+{
+    int rc;
+
+    struct mp_ipc_ctx *arg = p;
+
+    mp_thread_set_name("ipc/socket");
+
+    MP_VERBOSE(arg, "Starting IPC master\n");
+
+    int ipc_fd = ipc_listen(arg);
+    if (ipc_fd < 0)
+        goto done;
+
+#if HAVE_EPOLL
+    if (arg->single_thread) {
+        ipc_loop(arg, ipc_fd);
+        goto done;
+    }
+#endif
 
     int client_num = 0;
 
@@ -390,6 +765,7 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
         .path       = mp_get_user_path(arg, global, opts->ipc_path),
+        .single_thread = opts->ipc_single_thread,
         .death_pipe = {-1, -1},
     };
 
@@ -408,6 +784,11 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         }
     }
 
+#if !HAVE_EPOLL
+    if (arg->single_thread)
+        MP_WARN(arg, "--input-ipc-single-thread is not supported on this platform.\n");
+#endif
+
     talloc_free(opts);
 
     if (!arg->path || !arg->path[0])
@@ -47,6 +47,7 @@ struct client_arg {
     char *client_name;
     HANDLE client_h;
     bool writable;
+    enum mp_ipc_format format;
     OVERLAPPED write_ol;
 };
 
@@ -165,11 +166,11 @@ static bool pipe_error_is_fatal(DWORD error)
     return true;
 }
 
-static DWORD ipc_write_str(struct client_arg *arg, const char *buf)
+static DWORD ipc_write(struct client_arg *arg, bstr buf)
 {
     DWORD error = 0;
 
-    if ((error = async_write(arg->client_h, buf, strlen(buf), &arg->write_ol)))
+    if ((error = async_write(arg->client_h, buf.start, buf.len, &arg->write_ol)))
         goto done;
     if (!GetOverlappedResult(arg->client_h, &arg->write_ol, &(DWORD){0}, TRUE)) {
         error = GetLastError();
@@ -250,14 +251,15 @@ static MP_THREAD_VOID client_thread(void *p)
                 if (!arg->writable)
                     continue;
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
+                bstr event_msg = mp_ipc_encode_event(NULL, event, arg->format);
+                if (!event_msg.len) {
                     MP_ERR(arg, "Encoding error\n");
+                    talloc_free(event_msg.start);
                     goto done;
                 }
 
-                ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
+                ipc_write(arg, event_msg);
+                talloc_free(event_msg.start);
             }
 
             break;
@@ -269,12 +271,12 @@ static MP_THREAD_VOID client_thread(void *p)
             }
 
             bstr_xappend(NULL, &client_msg, (bstr){buf, r});
-            while (bstrchr(client_msg, '\n') != -1) {
-                char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                    NULL, &client_msg);
-                if (reply_msg && arg->writable)
-                    ipc_write_str(arg, reply_msg);
-                talloc_free(reply_msg);
+            while (mp_ipc_has_command(client_msg, arg->format)) {
+                bstr reply_msg = mp_ipc_consume_next_command(arg->client,
+                    NULL, &client_msg, &arg->format);
+                if (reply_msg.len && arg->writable)
+                    ipc_write(arg, reply_msg);
+                talloc_free(reply_msg.start);
             }
 
             // Begin the next read operation on the pipe
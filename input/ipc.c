@@ -20,6 +20,7 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "misc/node.h"
 #include "options/m_option.h"
 #include "options/options.h"
@@ -89,58 +90,75 @@ static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
     mpv_node_map_add(ta_parent, dst, "data", &cmd->result);
 }
 
-char *mp_json_encode_event(mpv_event *event)
+static void event_to_node(void *ta_parent, mpv_event *event,
+                          struct mpv_node *event_node)
 {
-    void *ta_parent = talloc_new(NULL);
-
-    struct mpv_node event_node;
     if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
-        event_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
-        mpv_format_command_reply(ta_parent, event, &event_node);
+        *event_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        mpv_format_command_reply(ta_parent, event, event_node);
     } else {
-        mpv_event_to_node(&event_node, event);
+        mpv_event_to_node(event_node, event);
         // Abuse mpv_event_to_node() internals.
-        talloc_steal(ta_parent, node_get_alloc(&event_node));
+        talloc_steal(ta_parent, node_get_alloc(event_node));
+    }
+}
+
+// Encode a message in the given format.
+static bstr encode_message(void *ta_parent, struct mpv_node *node,
+                           enum mp_ipc_format format)
+{
+    if (format == MP_IPC_MSGPACK) {
+        bstr output = {0};
+        msgpack_append_frame(&output, node);
+        talloc_steal(ta_parent, output.start);
+        return output;
     }
 
-    char *output = talloc_strdup(NULL, "");
-    json_write(&output, &event_node);
+    char *output = talloc_strdup(ta_parent, "");
+    json_write(&output, node);
     output = ta_talloc_strdup_append(output, "\n");
+    return bstr0(output);
+}
 
-    talloc_free(ta_parent);
+bstr mp_ipc_encode_event(void *ta_parent, mpv_event *event,
+                         enum mp_ipc_format format)
+{
+    void *tmp = talloc_new(NULL);
+
+    struct mpv_node event_node;
+    event_to_node(tmp, event, &event_node);
+
+    bstr output = encode_message(ta_parent, &event_node, format);
+
+    talloc_free(tmp);
 
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Execute the command in msg_node (NULL if it couldn't be parsed), and set
+// *reply_node to the reply. *format is changed if the client switches the
+// format. Returns false if no reply is to be sent.
+static bool execute_command(struct mpv_handle *client, void *ta_parent,
+                            mpv_node *msg_node, mpv_node *reply_node,
+                            enum mp_ipc_format *format)
 {
     int rc;
     const char *cmd = NULL;
     struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    *reply_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
     mpv_node *reqid_node = NULL;
     int64_t reqid = 0;
     mpv_node *async_node = NULL;
     bool async = false;
     bool send_reply = true;
 
-    rc = json_parse(ta_parent, &msg_node, &src, MAX_JSON_DEPTH);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
-    if (msg_node.format != MPV_FORMAT_NODE_MAP) {
+    if (!msg_node || msg_node->format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
     }
 
-    async_node = node_map_get(&msg_node, "async");
+    async_node = node_map_get(msg_node, "async");
     if (async_node) {
         if (async_node->format != MPV_FORMAT_FLAG) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -149,7 +167,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         async = async_node->u.flag;
     }
 
-    reqid_node = node_map_get(&msg_node, "request_id");
+    reqid_node = node_map_get(msg_node, "request_id");
     if (reqid_node) {
         if (reqid_node->format == MPV_FORMAT_INT64) {
             reqid = reqid_node->u.int64;
@@ -163,7 +181,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         }
     }
 
-    mpv_node *cmd_node = node_map_get(&msg_node, "command");
+    mpv_node *cmd_node = node_map_get(msg_node, "command");
     if (!cmd_node) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
@@ -181,15 +199,36 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
 
     if (cmd && !strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
+        rc = MPV_ERROR_SUCCESS;
+    } else if (cmd && !strcmp("set_ipc_format", cmd)) {
+        if (cmd_node->u.list->num != 2) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (!strcmp(name, "json")) {
+            *format = MP_IPC_JSON;
+        } else if (!strcmp(name, "msgpack")) {
+            *format = MP_IPC_MSGPACK;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_property", cmd)) {
         mpv_node result_node;
@@ -207,7 +246,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
                               MPV_FORMAT_NODE, &result_node);
         if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+            mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
             mpv_free_node_contents(&result_node);
         }
     } else if (cmd && !strcmp("get_property_string", cmd)) {
@@ -224,10 +263,10 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         char *result = mpv_get_property_string(client,
                                         cmd_node->u.list->values[1].u.string);
         if (result) {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
+            mpv_node_map_add_string(ta_parent, reply_node, "data", result);
             mpv_free(result);
         } else {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            mpv_node_map_add_null(ta_parent, reply_node, "data");
         }
     } else if (cmd && (!strcmp("set_property", cmd) ||
                        !strcmp("set_property_string", cmd)))
@@ -284,6 +323,25 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
                                   cmd_node->u.list->values[1].u.int64,
                                   cmd_node->u.list->values[2].u.string,
                                   MPV_FORMAT_STRING);
+    } else if (cmd && !strcmp("observe_property_diff", cmd)) {
+        if (cmd_node->u.list->num != 3) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_INT64) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[2].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_observe_property_diff(client,
+                                       cmd_node->u.list->values[1].u.int64,
+                                       cmd_node->u.list->values[2].u.string);
     } else if (cmd && !strcmp("unobserve_property", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -353,7 +411,7 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         } else {
             rc = mpv_command_node(client, cmd_node, &result_node);
             if (rc >= 0)
-                mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
         }
 
         mpv_free_node_contents(&result_node);
@@ -365,52 +423,97 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
     } else {
-        mpv_node_map_add_int64(ta_parent, &reply_node, "request_id", 0);
+        mpv_node_map_add_int64(ta_parent, reply_node, "request_id", 0);
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
 
-    char *output = talloc_strdup(ta_parent, "");
+    return send_reply;
+}
 
-    if (send_reply) {
-        json_write(&output, &reply_node);
-        output = ta_talloc_strdup_append(output, "\n");
-    }
+// Function is allowed to modify src[n].
+static bstr json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                 char *src, enum mp_ipc_format *format)
+{
+    struct mp_log *log = mp_client_get_log(client);
+    enum mp_ipc_format reply_format = *format;
 
-    return output;
+    mpv_node msg_node;
+    mpv_node reply_node;
+    int rc = json_parse(ta_parent, &msg_node, &src, MAX_JSON_DEPTH);
+    if (rc < 0)
+        mp_err(log, "malformed JSON received: '%s'\n", src);
+
+    if (!execute_command(client, ta_parent, rc < 0 ? NULL : &msg_node,
+                         &reply_node, format))
+        return (bstr){0};
+    return encode_message(ta_parent, &reply_node, reply_format);
 }
 
-static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
+static bstr msgpack_execute_command(struct mpv_handle *client, void *ta_parent,
+                                    bstr *buf, enum mp_ipc_format *format)
 {
-    mpv_command_string(client, src);
+    struct mp_log *log = mp_client_get_log(client);
+    enum mp_ipc_format reply_format = *format;
 
-    return NULL;
+    mpv_node msg_node;
+    mpv_node reply_node;
+    int rc = msgpack_parse_frame(ta_parent, &msg_node, buf, MAX_MSGPACK_DEPTH);
+    if (rc < 0)
+        mp_err(log, "malformed MessagePack received\n");
+
+    if (!execute_command(client, ta_parent, rc < 0 ? NULL : &msg_node,
+                         &reply_node, format))
+        return (bstr){0};
+    return encode_message(ta_parent, &reply_node, reply_format);
 }
 
-char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf)
+static bstr text_execute_command(struct mpv_handle *client, void *tmp, char *src)
 {
-    void *tmp = talloc_new(NULL);
+    mpv_command_string(client, src);
 
-    bstr rest;
-    bstr line = bstr_getline(*buf, &rest);
-    char *line0 = bstrto0(tmp, line);
-    talloc_steal(tmp, buf->start);
-    *buf = bstrdup(NULL, rest);
+    return (bstr){0};
+}
 
-    json_skip_whitespace(&line0);
+bool mp_ipc_has_command(bstr buf, enum mp_ipc_format format)
+{
+    if (format == MP_IPC_MSGPACK)
+        return msgpack_frame_size(buf) >= 0;
+    return bstrchr(buf, '\n') != -1;
+}
 
-    char *reply_msg = NULL;
-    if (line0[0] == '\0' || line0[0] == '#') {
-        // skip
-    } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
+bstr mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf,
+                                 enum mp_ipc_format *format)
+{
+    void *tmp = talloc_new(NULL);
+
+    bstr reply_msg = {0};
+    if (*format == MP_IPC_MSGPACK) {
+        bstr rest = *buf;
+        reply_msg = msgpack_execute_command(client, tmp, &rest, format);
+        talloc_steal(tmp, buf->start);
+        *buf = bstrdup(NULL, rest);
     } else {
-        reply_msg = text_execute_command(client, tmp, line0);
+        bstr rest;
+        bstr line = bstr_getline(*buf, &rest);
+        char *line0 = bstrto0(tmp, line);
+        talloc_steal(tmp, buf->start);
+        *buf = bstrdup(NULL, rest);
+
+        json_skip_whitespace(&line0);
+
+        if (line0[0] == '\0' || line0[0] == '#') {
+            // skip
+        } else if (line0[0] == '{') {
+            reply_msg = json_execute_command(client, tmp, line0, format);
+        } else {
+            reply_msg = text_execute_command(client, tmp, line0);
+        }
     }
 
-    talloc_steal(ctx, reply_msg);
+    talloc_steal(ctx, reply_msg.start);
     talloc_free(tmp);
     return reply_msg;
 }
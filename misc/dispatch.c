@@ -15,6 +15,7 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -25,7 +26,14 @@
 #include "dispatch.h"
 
 struct mp_dispatch_queue {
+    // Items in execution order. Protected by lock.
     struct mp_dispatch_item *head, *tail;
+    // Asynchronous items pushed without taking the lock, newest first. Moved
+    // to head/tail by whoever holds the lock next (see collect_incoming()).
+    _Atomic(struct mp_dispatch_item *) incoming;
+    // Number of mp_dispatch_push() calls that can still access the queue.
+    // Their item may have been run already, so the destructor waits for them.
+    atomic_int pushing;
     mp_mutex lock;
     mp_cond cond;
     void (*wakeup_fn)(void *wakeup_ctx);
@@ -34,8 +42,12 @@ struct mp_dispatch_queue {
     void *onlock_ctx;
     // Time at which mp_dispatch_queue_process() should return.
     int64_t wait;
-    // Make mp_dispatch_queue_process() exit if it's idle.
-    bool interrupted;
+    // Make mp_dispatch_queue_process() exit if it's idle. Set by lock-free
+    // enqueues, otherwise protected by lock.
+    atomic_bool interrupted;
+    // The target thread is about to block, or blocked in the timed wait of
+    // mp_dispatch_queue_process(). Lock-free enqueues need to signal cond.
+    atomic_bool sleeping;
     // The target thread is in mp_dispatch_queue_process() (and either idling,
     // locked, or running a dispatch callback).
     bool in_process;
@@ -63,7 +75,10 @@ struct mp_dispatch_item {
 static void queue_dtor(void *p)
 {
     struct mp_dispatch_queue *queue = p;
+    while (atomic_load(&queue->pushing))
+        mp_sleep_ns(MP_TIME_US_TO_NS(10));
     mp_assert(!queue->head);
+    mp_assert(!atomic_load(&queue->incoming));
     mp_assert(!queue->in_process);
     mp_assert(!queue->lock_requests);
     mp_assert(!queue->locked);
@@ -123,10 +138,35 @@ void mp_dispatch_set_onlock_fn(struct mp_dispatch_queue *queue,
     queue->onlock_ctx = onlock_ctx;
 }
 
+// Move lock-free enqueued items to the end of the locked list, restoring their
+// order. Returns whether there were any. Must be called with lock held.
+static bool collect_incoming(struct mp_dispatch_queue *queue)
+{
+    struct mp_dispatch_item *item = atomic_exchange(&queue->incoming, NULL);
+    if (!item)
+        return false;
+    struct mp_dispatch_item *first = NULL, *last = item;
+    while (item) {
+        struct mp_dispatch_item *next = item->next;
+        item->next = first;
+        first = item;
+        item = next;
+    }
+    if (queue->tail) {
+        queue->tail->next = first;
+    } else {
+        queue->head = first;
+    }
+    queue->tail = last;
+    return true;
+}
+
 static void mp_dispatch_append(struct mp_dispatch_queue *queue,
                                struct mp_dispatch_item *item)
 {
     mp_mutex_lock(&queue->lock);
+    // Keep the order relative to items that were enqueued lock-free.
+    collect_incoming(queue);
     if (item->mergeable) {
         for (struct mp_dispatch_item *cur = queue->head; cur; cur = cur->next) {
             if (cur->mergeable && cur->fn == item->fn &&
@@ -152,13 +192,46 @@ static void mp_dispatch_append(struct mp_dispatch_queue *queue,
     // No wakeup callback -> assume mp_dispatch_queue_process() needs to be
     // interrupted instead.
     if (!queue->wakeup_fn)
-        queue->interrupted = true;
+        atomic_store(&queue->interrupted, true);
     mp_mutex_unlock(&queue->lock);
 
     if (queue->wakeup_fn)
         queue->wakeup_fn(queue->wakeup_ctx);
 }
 
+// Like mp_dispatch_append(), but for asynchronous, non-mergeable items, which
+// nothing waits on and which need no lookup in the list. Many threads can
+// enqueue these at a high rate (e.g. vo_control_async()), so this avoids
+// contending on the lock, and only takes it if the target thread has to be
+// woken up from mp_dispatch_queue_process().
+static void mp_dispatch_push(struct mp_dispatch_queue *queue,
+                             struct mp_dispatch_item *item)
+{
+    atomic_fetch_add(&queue->pushing, 1);
+
+    struct mp_dispatch_item *head = atomic_load(&queue->incoming);
+    do {
+        item->next = head;
+    } while (!atomic_compare_exchange_weak(&queue->incoming, &head, item));
+
+    // This pairs with the sleeping/incoming check in
+    // mp_dispatch_queue_process(): either we see that it's sleeping, or it
+    // sees our item. (Both use sequentially consistent ordering.)
+    if (!queue->wakeup_fn && !atomic_load(&queue->interrupted))
+        atomic_store(&queue->interrupted, true);
+    if (atomic_load(&queue->sleeping)) {
+        mp_mutex_lock(&queue->lock);
+        mp_cond_broadcast(&queue->cond);
+        mp_mutex_unlock(&queue->lock);
+    }
+
+    if (queue->wakeup_fn)
+        queue->wakeup_fn(queue->wakeup_ctx);
+
+    // Must be the last access: the queue can be destroyed right after this.
+    atomic_fetch_sub(&queue->pushing, 1);
+}
+
 // Enqueue a callback to run it on the target thread asynchronously. The target
 // thread will run fn(fn_data) as soon as it enter mp_dispatch_queue_process.
 // Note that mp_dispatch_enqueue() will usually return long before that happens.
@@ -174,7 +247,7 @@ void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
         .fn_data = fn_data,
         .asynchronous = true,
     };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_push(queue, item);
 }
 
 // Like mp_dispatch_enqueue(), but the queue code will call talloc_free(fn_data)
@@ -190,7 +263,7 @@ void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
         .fn_data = talloc_steal(item, fn_data),
         .asynchronous = true,
     };
-    mp_dispatch_append(queue, item);
+    mp_dispatch_push(queue, item);
 }
 
 // Like mp_dispatch_enqueue(), but
@@ -219,6 +292,7 @@ void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data)
 {
     mp_mutex_lock(&queue->lock);
+    collect_incoming(queue);
     struct mp_dispatch_item **pcur = &queue->head;
     queue->tail = NULL;
     while (*pcur) {
@@ -283,7 +357,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
         if (queue->lock_requests) {
             // Block due to something having called mp_dispatch_lock().
             mp_cond_wait(&queue->cond, &queue->lock);
-        } else if (queue->head) {
+        } else if (queue->head || collect_incoming(queue)) {
             struct mp_dispatch_item *item = queue->head;
             queue->head = item->next;
             if (!queue->head)
@@ -309,16 +383,23 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
             } else {
                 item->completed = true;
             }
-        } else if (queue->wait > 0 && !queue->interrupted) {
-            if (mp_cond_timedwait_until(&queue->cond, &queue->lock, queue->wait))
+        } else if (queue->wait > 0 && !atomic_load(&queue->interrupted)) {
+            atomic_store(&queue->sleeping, true);
+            if (!atomic_load(&queue->incoming) &&
+                mp_cond_timedwait_until(&queue->cond, &queue->lock, queue->wait))
                 queue->wait = 0;
+            atomic_store(&queue->sleeping, false);
         } else {
             break;
         }
     }
     mp_assert(!queue->locked);
     queue->in_process = false;
-    queue->interrupted = false;
+    atomic_store(&queue->interrupted, false);
+    // An item enqueued lock-free after the last check must still interrupt the
+    // next call, as if it had been enqueued after this one returned.
+    if (!queue->wakeup_fn && atomic_load(&queue->incoming))
+        atomic_store(&queue->interrupted, true);
     mp_mutex_unlock(&queue->lock);
 }
 
@@ -331,7 +412,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 void mp_dispatch_interrupt(struct mp_dispatch_queue *queue)
 {
     mp_mutex_lock(&queue->lock);
-    queue->interrupted = true;
+    atomic_store(&queue->interrupted, true);
     mp_cond_broadcast(&queue->cond);
     mp_mutex_unlock(&queue->lock);
 }
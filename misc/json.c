@@ -56,6 +56,17 @@
 
 #include "json.h"
 
+// Scratch space shared by all nesting levels of a single json_parse() call.
+// Array and object items are collected here, and copied into an exactly sized
+// list once the closing bracket is reached, instead of growing every list
+// item by item.
+struct parse_ctx {
+    void *ta_parent;
+    struct mpv_node *values;
+    char **keys;
+    int num_items;
+};
+
 static bool eat_c(char **s, char c)
 {
     if (**s == c) {
@@ -105,13 +116,16 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     char *str = *src;
     char *cur = str;
     bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
-        }
+    while (1) {
+        // libc's strcspn() is vectorized on most platforms, and string bodies
+        // are usually the bulk of the input.
+        cur += strcspn(cur, "\"\\");
+        if (cur[0] != '\\')
+            break;
+        has_escapes = true;
+        // skip >\"< and >\\< (latter to handle >\\"< correctly)
+        if (cur[1] == '"' || cur[1] == '\\')
+            cur++;
         cur++;
     }
     if (cur[0] != '"')
@@ -132,7 +146,35 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     return 0;
 }
 
-static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
+// Plain decimal integers are by far the most common numbers, and can be
+// parsed without running both strtoll() and strtod() on them.
+static bool read_simple_int(struct mpv_node *dst, char **src)
+{
+    char *cur = *src;
+    bool neg = eat_c(&cur, '-');
+    // Leading zeros are left to strtoll(), which parses them as octal.
+    if (cur[0] < '1' || cur[0] > '9')
+        return false;
+    int64_t v = 0;
+    int digits = 0;
+    while (cur[0] >= '0' && cur[0] <= '9' && digits < 18) {
+        v = v * 10 + (cur[0] - '0');
+        digits++;
+        cur++;
+    }
+    if ((cur[0] >= '0' && cur[0] <= '9') || cur[0] == '.' || cur[0] == 'e' ||
+        cur[0] == 'E')
+        return false;
+    *src = cur;
+    dst->format = MPV_FORMAT_INT64;
+    dst->u.int64 = neg ? -v : v;
+    return true;
+}
+
+static int parse_value(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
+                       int max_depth);
+
+static int read_sub(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
                     int max_depth)
 {
     bool is_arr = eat_c(src, '[');
@@ -140,53 +182,58 @@ static int read_sub(void *ta_parent, struct mpv_node *dst, char **src,
     if (!is_arr && !is_obj)
         return -1; // not an array or object
     char term = is_obj ? '}' : ']';
-    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    int first = ctx->num_items;
     while (1) {
         eat_ws(src);
         if (eat_c(src, term))
             break;
-        if (list->num > 0 && !eat_c(src, ','))
+        if (ctx->num_items > first && !eat_c(src, ','))
             return -1; // missing ','
         eat_ws(src);
         // non-standard extension: allow a trailing ","
         if (eat_c(src, term))
             break;
+        struct mpv_node keynode = {0};
         if (is_obj) {
-            struct mpv_node keynode;
             // non-standard extension: allow unquoted strings as keys
-            if (read_id(list, &keynode, src) < 0 &&
-                read_str(list, &keynode, src) < 0)
+            if (read_id(ctx->ta_parent, &keynode, src) < 0 &&
+                read_str(ctx->ta_parent, &keynode, src) < 0)
                 return -1; // key is not a string
             eat_ws(src);
             // non-standard extension: allow "=" instead of ":"
             if (!eat_c(src, ':') && !eat_c(src, '='))
                 return -1; // ':' missing
             eat_ws(src);
-            MP_TARRAY_GROW(list, list->keys, list->num);
-            list->keys[list->num] = keynode.u.string;
         }
-        MP_TARRAY_GROW(list, list->values, list->num);
-        if (json_parse(ta_parent, &list->values[list->num], src, max_depth) < 0)
+        // Parse into a local, since nested lists can reallocate ctx->values.
+        struct mpv_node value;
+        if (parse_value(ctx, &value, src, max_depth) < 0)
             return -1;
-        list->num++;
+        MP_TARRAY_GROW(NULL, ctx->values, ctx->num_items);
+        MP_TARRAY_GROW(NULL, ctx->keys, ctx->num_items);
+        ctx->values[ctx->num_items] = value;
+        ctx->keys[ctx->num_items] = keynode.u.string;
+        ctx->num_items++;
     }
+    int num = ctx->num_items - first;
+    struct mpv_node_list *list = talloc_zero(ctx->ta_parent, struct mpv_node_list);
+    if (num) {
+        list->values = talloc_memdup(list, &ctx->values[first],
+                                     num * sizeof(list->values[0]));
+        if (is_obj) {
+            list->keys = talloc_memdup(list, &ctx->keys[first],
+                                       num * sizeof(list->keys[0]));
+        }
+    }
+    list->num = num;
+    ctx->num_items = first;
     dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
     dst->u.list = list;
     return 0;
 }
 
-/* Parse the string in *src as JSON, and write the result into *dst.
- * max_depth limits the recursion and JSON tree depth.
- * Warning: this overwrites the input string (what *src points to)!
- * Returns:
- *   0: success, *dst is valid, *src points to the end (the caller must check
- *      whether *src really terminates)
- *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
- *      (ta_free_children(ta_parent) is the only way to free them)
- * The input string can be mutated in both cases. *dst might contain string
- * elements, which point into the (mutated) input string.
- */
-int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
+static int parse_value(struct parse_ctx *ctx, struct mpv_node *dst, char **src,
+                       int max_depth)
 {
     max_depth -= 1;
     if (max_depth < 0)
@@ -212,10 +259,12 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
         dst->u.flag = 0;
         return 0;
     } else if (c == '"') {
-        return read_str(ta_parent, dst, src);
+        return read_str(ctx->ta_parent, dst, src);
     } else if (c == '[' || c == '{') {
-        return read_sub(ta_parent, dst, src, max_depth);
+        return read_sub(ctx, dst, src, max_depth);
     } else if (c == '-' || (c >= '0' && c <= '9')) {
+        if (read_simple_int(dst, src))
+            return 0;
         // The number could be either a float or an int. JSON doesn't make a
         // difference, but the client API does.
         char *nsrci = *src, *nsrcf = *src;
@@ -244,100 +293,173 @@ int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
     return -1; // character doesn't start a valid token
 }
 
+/* Parse the string in *src as JSON, and write the result into *dst.
+ * max_depth limits the recursion and JSON tree depth.
+ * Warning: this overwrites the input string (what *src points to)!
+ * Returns:
+ *   0: success, *dst is valid, *src points to the end (the caller must check
+ *      whether *src really terminates)
+ *  -1: failure, *dst is invalid, there may be dead allocs under ta_parent
+ *      (ta_free_children(ta_parent) is the only way to free them)
+ * The input string can be mutated in both cases. *dst might contain string
+ * elements, which point into the (mutated) input string.
+ */
+int json_parse(void *ta_parent, struct mpv_node *dst, char **src, int max_depth)
+{
+    struct parse_ctx ctx = {.ta_parent = ta_parent};
+    int r = parse_value(&ctx, dst, src, max_depth);
+    talloc_free(ctx.values);
+    talloc_free(ctx.keys);
+    return r;
+}
+
+
+// Output is collected in a fixed buffer, and only copied to the destination
+// bstr when it's full. Appending many small pieces to the bstr directly
+// spends most of the time on checking the allocation size.
+struct writer {
+    bstr *dst;
+    size_t len;
+    unsigned char buf[4096];
+};
+
+static void flush(struct writer *w)
+{
+    bstr_xappend(NULL, w->dst, (bstr){w->buf, w->len});
+    w->len = 0;
+}
+
+static void append(struct writer *w, const void *data, size_t len)
+{
+    if (len > sizeof(w->buf) - w->len) {
+        flush(w);
+        if (len > sizeof(w->buf)) {
+            bstr_xappend(NULL, w->dst, (bstr){(void *)data, len});
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
 
-#define APPEND(b, s) bstr_xappend(NULL, (b), bstr0(s))
+#define APPEND(w, s) append((w), (s), strlen(s))
 
-static const char special_escape[] = {
-    ['\b'] = 'b',
-    ['\f'] = 'f',
-    ['\n'] = 'n',
-    ['\r'] = 'r',
-    ['\t'] = 't',
+// For each byte, the character following the '\' when writing it in a JSON
+// string, or 0 if the byte can be written as is. 'u' means "\u00XX".
+static const char escape_table[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    ['"'] = '"',
+    ['\\'] = '\\',
 };
 
-static void write_json_str(bstr *b, unsigned char *str)
+static void write_json_str(struct writer *w, unsigned char *str)
 {
     mp_assert(str);
 
-    APPEND(b, "\"");
+    APPEND(w, "\"");
     while (1) {
         unsigned char *cur = str;
-        while (cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
+        while (!escape_table[cur[0]])
             cur++;
+        append(w, str, cur - str);
         if (!cur[0])
             break;
-        bstr_xappend(NULL, b, (bstr){str, cur - str});
-        if (cur[0] == '\"') {
-            bstr_xappend(NULL, b, (bstr){"\\\"", 2});
-        } else if (cur[0] == '\\') {
-            bstr_xappend(NULL, b, (bstr){"\\\\", 2});
-        } else if (cur[0] < sizeof(special_escape) && special_escape[cur[0]]) {
-            bstr_xappend_asprintf(NULL, b, "\\%c", special_escape[cur[0]]);
-        } else {
-            bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
+        char esc[6] = {'\\', escape_table[cur[0]]};
+        int len = 2;
+        if (esc[1] == 'u') {
+            static const char hex[] = "0123456789abcdef";
+            esc[2] = esc[3] = '0';
+            esc[4] = hex[cur[0] >> 4];
+            esc[5] = hex[cur[0] & 15];
+            len = 6;
         }
+        append(w, esc, len);
         str = cur + 1;
     }
-    APPEND(b, str);
-    APPEND(b, "\"");
+    APPEND(w, "\"");
+}
+
+// Equivalent to printing with "%"PRId64, without going through printf.
+static void write_int(struct writer *w, int64_t v)
+{
+    char buf[24];
+    char *end = buf + sizeof(buf), *cur = end;
+    uint64_t u = v < 0 ? -(uint64_t)v : v;
+    do {
+        *--cur = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (v < 0)
+        *--cur = '-';
+    append(w, cur, end - cur);
 }
 
-static void add_indent(bstr *b, int indent)
+static void add_indent(struct writer *w, int indent)
 {
     if (indent < 0)
         return;
-    bstr_xappend(NULL, b, bstr0("\n"));
+    APPEND(w, "\n");
     for (int n = 0; n < indent; n++)
-        bstr_xappend(NULL, b, bstr0(" "));
+        APPEND(w, " ");
 }
 
-int json_append(bstr *b, const struct mpv_node *src, int indent)
+static int write_node(struct writer *w, const struct mpv_node *src, int indent)
 {
     switch (src->format) {
     case MPV_FORMAT_NONE:
-        APPEND(b, "null");
+        APPEND(w, "null");
         return 0;
     case MPV_FORMAT_FLAG:
-        APPEND(b, src->u.flag ? "true" : "false");
+        APPEND(w, src->u.flag ? "true" : "false");
         return 0;
     case MPV_FORMAT_INT64:
-        bstr_xappend_asprintf(NULL, b, "%"PRId64, src->u.int64);
+        write_int(w, src->u.int64);
         return 0;
     case MPV_FORMAT_DOUBLE: {
         const char *px = (isfinite(src->u.double_) || indent == 0) ? "" : "\"";
-        bstr_xappend_asprintf(NULL, b, "%s%f%s", px, src->u.double_, px);
+        flush(w);
+        bstr_xappend_asprintf(NULL, w->dst, "%s%f%s", px, src->u.double_, px);
         return 0;
     }
     case MPV_FORMAT_STRING:
         if (indent == 0)
-            APPEND(b, src->u.string);
+            APPEND(w, src->u.string);
         else
-            write_json_str(b, src->u.string);
+            write_json_str(w, src->u.string);
         return 0;
     case MPV_FORMAT_NODE_ARRAY:
     case MPV_FORMAT_NODE_MAP: {
         struct mpv_node_list *list = src->u.list;
         bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
-        APPEND(b, is_obj ? "{" : "[");
+        APPEND(w, is_obj ? "{" : "[");
         int next_indent = indent >= 0 ? indent + 1 : -1;
         for (int n = 0; n < list->num; n++) {
             if (n)
-                APPEND(b, ",");
-            add_indent(b, next_indent);
+                APPEND(w, ",");
+            add_indent(w, next_indent);
             if (is_obj) {
-                write_json_str(b, list->keys[n]);
-                APPEND(b, ":");
+                write_json_str(w, list->keys[n]);
+                APPEND(w, ":");
             }
-            json_append(b, &list->values[n], next_indent);
+            write_node(w, &list->values[n], next_indent);
         }
-        add_indent(b, indent);
-        APPEND(b, is_obj ? "}" : "]");
+        add_indent(w, indent);
+        APPEND(w, is_obj ? "}" : "]");
         return 0;
     }
     }
     return -1; // unknown format
 }
 
+int json_append(bstr *b, const struct mpv_node *src, int indent)
+{
+    struct writer w = {.dst = b};
+    int r = write_node(&w, src, indent);
+    flush(&w);
+    return r;
+}
+
 static int json_append_str(char **dst, struct mpv_node *src, int indent)
 {
     bstr buffer = bstr0(*dst);
@@ -0,0 +1,361 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack parser and writer for mpv_node.
+ *
+ * Supports the subset of MessagePack that maps to mpv_node: nil, bool,
+ * integers, floats, str, bin (as MPV_FORMAT_BYTE_ARRAY), array, and maps with
+ * str keys. Integers that don't fit into int64_t and ext types are rejected.
+ *
+ * Frames are a value prefixed with its size in bytes as 32 bit big endian
+ * integer, which allows reading a full message without parsing it.
+ *
+ * Also see: https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mpv/client.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+
+#include "msgpack.h"
+
+static uint64_t read_be(const unsigned char *p, int size)
+{
+    uint64_t v = 0;
+    for (int n = 0; n < size; n++)
+        v = (v << 8) | p[n];
+    return v;
+}
+
+static void write_be(unsigned char *p, uint64_t v, int size)
+{
+    for (int n = size - 1; n >= 0; n--) {
+        p[n] = v & 0xFF;
+        v >>= 8;
+    }
+}
+
+// Consume size bytes from src, or return NULL if there aren't enough.
+static unsigned char *eat_bytes(bstr *src, uint64_t size)
+{
+    if (src->len < size)
+        return NULL;
+    unsigned char *p = src->start;
+    *src = bstr_cut(*src, size);
+    return p;
+}
+
+static bool eat_be(bstr *src, int size, uint64_t *out)
+{
+    unsigned char *p = eat_bytes(src, size);
+    if (p)
+        *out = read_be(p, size);
+    return !!p;
+}
+
+static int parse_str(void *ta_parent, struct mpv_node *dst, bstr *src,
+                     uint64_t len)
+{
+    unsigned char *p = eat_bytes(src, len);
+    if (!p)
+        return -1;
+    *dst = (struct mpv_node){
+        .format = MPV_FORMAT_STRING,
+        .u.string = talloc_strndup(ta_parent, p, len),
+    };
+    return 0;
+}
+
+static int parse_list(void *ta_parent, struct mpv_node *dst, bstr *src,
+                      uint64_t num, bool is_map, int max_depth)
+{
+    if (max_depth <= 0)
+        return -1;
+    // Every entry takes at least 1 byte; reject bogus sizes early.
+    if (num > src->len)
+        return -1;
+
+    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    dst->format = is_map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+    if (!num)
+        return 0;
+
+    list->values = talloc_array(list, struct mpv_node, num);
+    if (is_map)
+        list->keys = talloc_array(list, char *, num);
+    for (uint64_t n = 0; n < num; n++) {
+        if (is_map) {
+            struct mpv_node key;
+            if (msgpack_parse(list, &key, src, 0) < 0 ||
+                key.format != MPV_FORMAT_STRING)
+                return -1;
+            list->keys[n] = key.u.string;
+        }
+        if (msgpack_parse(list, &list->values[n], src, max_depth - 1) < 0)
+            return -1;
+        list->num++;
+    }
+    return 0;
+}
+
+/* Parse one value from *src and set *dst to it, and advance *src to the end
+ * of the value. Strings and lists are allocated with ta_parent as parent.
+ * max_depth limits the nesting of arrays and maps. A max_depth of 0 allows
+ * only scalar values.
+ * Returns: 0 on success, <0 on failure (including incomplete input).
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    unsigned char *p = eat_bytes(src, 1);
+    if (!p)
+        return -1;
+    unsigned char c = p[0];
+    uint64_t v;
+
+    if (c <= 0x7F) {
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = c};
+        return 0;
+    }
+    if (c >= 0xE0) {
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64,
+                                 .u.int64 = (int8_t)c};
+        return 0;
+    }
+    if ((c & 0xE0) == 0xA0)
+        return parse_str(ta_parent, dst, src, c & 0x1F);
+    if ((c & 0xF0) == 0x90)
+        return parse_list(ta_parent, dst, src, c & 0x0F, false, max_depth);
+    if ((c & 0xF0) == 0x80)
+        return parse_list(ta_parent, dst, src, c & 0x0F, true, max_depth);
+
+    switch (c) {
+    case 0xC0:
+        *dst = (struct mpv_node){.format = MPV_FORMAT_NONE};
+        return 0;
+    case 0xC2:
+    case 0xC3:
+        *dst = (struct mpv_node){.format = MPV_FORMAT_FLAG, .u.flag = c == 0xC3};
+        return 0;
+    case 0xCC: case 0xCD: case 0xCE: case 0xCF: {
+        if (!eat_be(src, 1 << (c - 0xCC), &v) || v > INT64_MAX)
+            return -1;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = v};
+        return 0;
+    }
+    case 0xD0: case 0xD1: case 0xD2: case 0xD3: {
+        int size = 1 << (c - 0xD0);
+        if (!eat_be(src, size, &v))
+            return -1;
+        // Sign-extend.
+        int shift = 64 - size * 8;
+        int64_t i = (int64_t)(v << shift) >> shift;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = i};
+        return 0;
+    }
+    case 0xCA: {
+        if (!eat_be(src, 4, &v))
+            return -1;
+        float f;
+        uint32_t u = v;
+        memcpy(&f, &u, sizeof(f));
+        *dst = (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = f};
+        return 0;
+    }
+    case 0xCB: {
+        if (!eat_be(src, 8, &v))
+            return -1;
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        *dst = (struct mpv_node){.format = MPV_FORMAT_DOUBLE, .u.double_ = d};
+        return 0;
+    }
+    case 0xD9: case 0xDA: case 0xDB:
+        if (!eat_be(src, 1 << (c - 0xD9), &v))
+            return -1;
+        return parse_str(ta_parent, dst, src, v);
+    case 0xC4: case 0xC5: case 0xC6: {
+        if (!eat_be(src, 1 << (c - 0xC4), &v))
+            return -1;
+        unsigned char *data = eat_bytes(src, v);
+        if (!data)
+            return -1;
+        struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ba, data, v);
+        ba->size = v;
+        *dst = (struct mpv_node){.format = MPV_FORMAT_BYTE_ARRAY, .u.ba = ba};
+        return 0;
+    }
+    case 0xDC: case 0xDD:
+        if (!eat_be(src, 2 << (c - 0xDC), &v))
+            return -1;
+        return parse_list(ta_parent, dst, src, v, false, max_depth);
+    case 0xDE: case 0xDF:
+        if (!eat_be(src, 2 << (c - 0xDE), &v))
+            return -1;
+        return parse_list(ta_parent, dst, src, v, true, max_depth);
+    }
+    return -1; // ext types and reserved bytes
+}
+
+// Append a type byte c followed by v as big endian integer of the given size.
+static void append_tagged(bstr *b, unsigned char c, uint64_t v, int size)
+{
+    unsigned char buf[9] = {c};
+    write_be(buf + 1, v, size);
+    bstr_xappend(NULL, b, (bstr){buf, 1 + size});
+}
+
+// Append a header for str/bin/array/map. fix is the fixed size type byte (or
+// 0 if none), fix_max its maximum size, and tag the type byte for the
+// variant with 8 bit size (or 16 bit size for array/map).
+static void append_header(bstr *b, unsigned char fix, uint64_t fix_max,
+                          unsigned char tag, int min_size, uint64_t size)
+{
+    if (fix && size <= fix_max) {
+        append_tagged(b, fix | size, 0, 0);
+    } else if (min_size == 1 && size <= UINT8_MAX) {
+        append_tagged(b, tag, size, 1);
+    } else if (size <= UINT16_MAX) {
+        append_tagged(b, tag + (min_size == 1), size, 2);
+    } else {
+        append_tagged(b, tag + (min_size == 1) + 1, size, 4);
+    }
+}
+
+static void append_int(bstr *b, int64_t v)
+{
+    if (v >= 0 && v <= 0x7F) {
+        append_tagged(b, v, 0, 0);
+    } else if (v < 0 && v >= -32) {
+        append_tagged(b, (uint8_t)v, 0, 0);
+    } else if (v >= 0) {
+        int size = v <= UINT8_MAX ? 1 : v <= UINT16_MAX ? 2 :
+                   v <= UINT32_MAX ? 4 : 8;
+        append_tagged(b, 0xCC + mp_log2(size), v, size);
+    } else {
+        int size = v >= INT8_MIN ? 1 : v >= INT16_MIN ? 2 :
+                   v >= INT32_MIN ? 4 : 8;
+        append_tagged(b, 0xD0 + mp_log2(size), v, size);
+    }
+}
+
+/* Append the MessagePack encoding of *src to *b, which is extended with
+ * bstr_xappend().
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_append(bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        append_tagged(b, 0xC0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        append_tagged(b, src->u.flag ? 0xC3 : 0xC2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64:
+        append_int(b, src->u.int64);
+        return 0;
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t v;
+        memcpy(&v, &src->u.double_, sizeof(v));
+        append_tagged(b, 0xCB, v, 8);
+        return 0;
+    }
+    case MPV_FORMAT_STRING: {
+        size_t len = strlen(src->u.string);
+        append_header(b, 0xA0, 0x1F, 0xD9, 1, len);
+        bstr_xappend(NULL, b, (bstr){src->u.string, len});
+        return 0;
+    }
+    case MPV_FORMAT_BYTE_ARRAY:
+        append_header(b, 0, 0, 0xC4, 1, src->u.ba->size);
+        bstr_xappend(NULL, b, (bstr){src->u.ba->data, src->u.ba->size});
+        return 0;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_map = src->format == MPV_FORMAT_NODE_MAP;
+        append_header(b, is_map ? 0x80 : 0x90, 0x0F, is_map ? 0xDE : 0xDC, 2,
+                      list->num);
+        for (int n = 0; n < list->num; n++) {
+            if (is_map) {
+                struct mpv_node key = {.format = MPV_FORMAT_STRING,
+                                       .u.string = list->keys[n]};
+                msgpack_append(b, &key);
+            }
+            if (msgpack_append(b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+/* Return the total size of the first frame in src, or -1 if src doesn't
+ * contain a complete frame yet.
+ */
+int msgpack_frame_size(bstr src)
+{
+    if (src.len < MSGPACK_FRAME_HEADER)
+        return -1;
+    uint64_t size = read_be(src.start, MSGPACK_FRAME_HEADER);
+    if (size > INT_MAX - MSGPACK_FRAME_HEADER ||
+        src.len < size + MSGPACK_FRAME_HEADER)
+        return -1;
+    return size + MSGPACK_FRAME_HEADER;
+}
+
+/* Parse a complete frame from *src as with msgpack_parse(), and advance *src
+ * to the end of the frame. Fails if the frame is incomplete, or the value
+ * doesn't fill the frame exactly.
+ */
+int msgpack_parse_frame(void *ta_parent, struct mpv_node *dst, bstr *src,
+                        int max_depth)
+{
+    int size = msgpack_frame_size(*src);
+    if (size < 0)
+        return -1;
+    bstr frame = bstr_splice(*src, MSGPACK_FRAME_HEADER, size);
+    *src = bstr_cut(*src, size);
+    if (msgpack_parse(ta_parent, dst, &frame, max_depth) < 0 || frame.len)
+        return -1;
+    return 0;
+}
+
+// Append *src as frame to *b.
+int msgpack_append_frame(bstr *b, const struct mpv_node *src)
+{
+    size_t start = b->len;
+    unsigned char header[MSGPACK_FRAME_HEADER] = {0};
+    bstr_xappend(NULL, b, (bstr){header, sizeof(header)});
+    int r = msgpack_append(b, src);
+    if (r < 0) {
+        b->len = start;
+        return r;
+    }
+    write_be(b->start + start, b->len - start - MSGPACK_FRAME_HEADER,
+             MSGPACK_FRAME_HEADER);
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MP_MSGPACK_H
+#define MP_MSGPACK_H
+
+#include <stdbool.h>
+
+#define MAX_MSGPACK_DEPTH 50
+
+// Size of the length prefix of a frame.
+#define MSGPACK_FRAME_HEADER 4
+
+struct bstr;
+struct mpv_node;
+
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, struct bstr *src,
+                  int max_depth);
+int msgpack_append(struct bstr *b, const struct mpv_node *src);
+int msgpack_frame_size(struct bstr src);
+int msgpack_parse_frame(void *ta_parent, struct mpv_node *dst, struct bstr *src,
+                        int max_depth);
+int msgpack_append_frame(struct bstr *b, const struct mpv_node *src);
+
+#endif
@@ -169,3 +169,206 @@ bool equal_mpv_node(const struct mpv_node *a, const struct mpv_node *b)
         return false;
     return equal_mpv_value(&a->u, &b->u, a->format);
 }
+
+struct diff_key {
+    int64_t id;
+    const char *type;
+    int index;
+};
+
+static bool get_diff_key(struct mpv_node *entry, int index, struct diff_key *key)
+{
+    struct mpv_node *id = node_map_get(entry, "id");
+    if (!id || id->format != MPV_FORMAT_INT64)
+        return false;
+    struct mpv_node *type = node_map_get(entry, "type");
+    *key = (struct diff_key){
+        .id = id->u.int64,
+        .type = type && type->format == MPV_FORMAT_STRING ? type->u.string : "",
+        .index = index,
+    };
+    return true;
+}
+
+static int compare_diff_key(const void *pa, const void *pb)
+{
+    const struct diff_key *a = pa, *b = pb;
+    if (a->id != b->id)
+        return a->id > b->id ? 1 : -1;
+    return strcmp(a->type, b->type);
+}
+
+// Set *out to the sorted keys of all array entries. Fails if an entry has no
+// key, or if a key is not unique.
+static bool get_diff_keys(void *ta_parent, struct mpv_node_list *list,
+                          struct diff_key **out)
+{
+    struct diff_key *keys = talloc_array(ta_parent, struct diff_key, list->num);
+    for (int n = 0; n < list->num; n++) {
+        if (!get_diff_key(&list->values[n], n, &keys[n]))
+            return false;
+    }
+    qsort(keys, list->num, sizeof(keys[0]), compare_diff_key);
+    for (int n = 1; n < list->num; n++) {
+        if (compare_diff_key(&keys[n - 1], &keys[n]) == 0)
+            return false;
+    }
+    *out = keys;
+    return true;
+}
+
+// Index of the entry with the same key as entry, or -1.
+static int find_diff_key(struct diff_key *keys, int num, struct mpv_node *entry)
+{
+    struct diff_key key;
+    if (!num || !get_diff_key(entry, -1, &key))
+        return -1;
+    struct diff_key *res =
+        bsearch(&key, keys, num, sizeof(keys[0]), compare_diff_key);
+    return res ? res->index : -1;
+}
+
+// Fenwick tree helpers.
+static void count_add(int *counts, int num, int i, int v)
+{
+    for (i += 1; i <= num; i += i & -i)
+        counts[i - 1] += v;
+}
+
+// Sum of the counts in [0, i).
+static int count_sum(int *counts, int i)
+{
+    int sum = 0;
+    for (; i > 0; i -= i & -i)
+        sum += counts[i - 1];
+    return sum;
+}
+
+// Mark the entries of the longest run of new entries that are still in their
+// old relative order. These are left alone, everything else is moved.
+static void mark_stable(void *ta_parent, int *old_pos, int num, bool *stable)
+{
+    int *tails = talloc_array(ta_parent, int, num);
+    int *prev = talloc_array(ta_parent, int, num);
+    int len = 0;
+    for (int k = 0; k < num; k++) {
+        stable[k] = false;
+        if (old_pos[k] < 0)
+            continue;
+        int lo = 0, hi = len;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (old_pos[tails[mid]] < old_pos[k]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        prev[k] = lo > 0 ? tails[lo - 1] : -1;
+        tails[lo] = k;
+        len = MPMAX(len, lo + 1);
+    }
+    for (int k = len > 0 ? tails[len - 1] : -1; k >= 0; k = prev[k])
+        stable[k] = true;
+}
+
+static void add_diff_op(struct mpv_node *dst, const char *op, int index,
+                        int from, struct mpv_node *value)
+{
+    struct mpv_node *entry = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+    node_map_add_string(entry, "op", op);
+    node_map_add_int64(entry, "index", index);
+    if (from >= 0)
+        node_map_add_int64(entry, "from", from);
+    if (value)
+        *node_map_add(entry, "value", MPV_FORMAT_NONE) = *value;
+}
+
+// Append the operations that turn the MPV_FORMAT_NODE_ARRAY old into new to
+// dst (a MPV_FORMAT_NODE_ARRAY). Entries are maps, and are identified by their
+// "id" field (plus "type", if present). Each operation is a map with an "op"
+// field ("remove", "insert", "move", "change"), the "index" it applies to, the
+// source index "from" for moves, and the new entry "value" for inserts and
+// changes. Operations apply in order; indexes refer to the array as left by
+// the previous operation.
+// The "value" fields reference the entries in new without copying them.
+// Returns false if an entry has no key, or keys are not unique.
+bool node_array_diff(struct mpv_node *dst, struct mpv_node *old,
+                     struct mpv_node *new)
+{
+    mp_assert(old->format == MPV_FORMAT_NODE_ARRAY);
+    mp_assert(new->format == MPV_FORMAT_NODE_ARRAY);
+    struct mpv_node_list *ol = old->u.list, *nl = new->u.list;
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+
+    struct diff_key *old_keys, *new_keys;
+    if (!get_diff_keys(tmp, ol, &old_keys) || !get_diff_keys(tmp, nl, &new_keys))
+        goto done;
+
+    int *old_pos = talloc_array(tmp, int, nl->num);
+    for (int k = 0; k < nl->num; k++)
+        old_pos[k] = find_diff_key(old_keys, ol->num, &nl->values[k]);
+
+    bool *stable = talloc_array(tmp, bool, nl->num);
+    mark_stable(tmp, old_pos, nl->num, stable);
+
+    // Moved and inserted entries are placed in front of the next stable entry
+    // (or the end of the array). Number all positions an entry can take: for
+    // each old entry, the entries placed in front of it, then the entry itself.
+    int *group = talloc_zero_array(tmp, int, ol->num + 1);
+    int anchor = ol->num;
+    for (int k = nl->num - 1; k >= 0; k--) {
+        if (stable[k]) {
+            anchor = old_pos[k];
+        } else {
+            group[anchor] += 1;
+        }
+    }
+    int *old_slot = talloc_array(tmp, int, ol->num + 1);
+    int num_slots = 0;
+    for (int i = 0; i <= ol->num; i++) {
+        num_slots += group[i];
+        old_slot[i] = num_slots++;
+    }
+
+    // Which positions are currently occupied.
+    int *present = talloc_zero_array(tmp, int, num_slots);
+    for (int i = ol->num - 1; i >= 0; i--) {
+        if (find_diff_key(new_keys, nl->num, &ol->values[i]) < 0) {
+            add_diff_op(dst, "remove", i, -1, NULL);
+        } else {
+            count_add(present, num_slots, old_slot[i], 1);
+        }
+    }
+
+    int slot = old_slot[ol->num];
+    for (int k = nl->num - 1; k >= 0; k--) {
+        int i = old_pos[k];
+        if (stable[k]) {
+            slot = old_slot[i];
+            continue;
+        }
+        slot -= 1;
+        if (i >= 0) {
+            int from = count_sum(present, old_slot[i]);
+            count_add(present, num_slots, old_slot[i], -1);
+            add_diff_op(dst, "move", count_sum(present, slot), from, NULL);
+        } else {
+            add_diff_op(dst, "insert", count_sum(present, slot), -1,
+                        &nl->values[k]);
+        }
+        count_add(present, num_slots, slot, 1);
+    }
+
+    for (int k = 0; k < nl->num; k++) {
+        int i = old_pos[k];
+        if (i >= 0 && !equal_mpv_node(&ol->values[i], &nl->values[k]))
+            add_diff_op(dst, "change", k, -1, &nl->values[k]);
+    }
+
+    ok = true;
+done:
+    talloc_free(tmp);
+    return ok;
+}
@@ -20,5 +20,7 @@ struct mpv_node *node_map_get(struct mpv_node *src, const char *key);
 struct mpv_node *node_map_bget(struct mpv_node *src, struct bstr key);
 bool equal_mpv_value(const void *a, const void *b, int format);
 bool equal_mpv_node(const struct mpv_node *a, const struct mpv_node *b);
+bool node_array_diff(struct mpv_node *dst, struct mpv_node *old,
+                     struct mpv_node *new);
 
 #endif
@@ -35,7 +35,7 @@
 #include "common/common.h"
 
 static int m_property_multiply(struct mp_log *log,
-                               const struct m_property *prop_list,
+                               const struct m_property_list *prop_list,
                                const char *property, double f, void *ctx)
 {
     union m_option_value val = m_option_value_default;
@@ -60,26 +60,79 @@ static int m_property_multiply(struct mp_log *log,
     return r;
 }
 
-struct m_property *m_property_list_find(const struct m_property *list,
-                                        const char *name)
+struct m_property_list {
+    struct m_property *props;
+    int num_props;
+    // Same entries as props, sorted by name, and by position for equal names.
+    struct m_property **sorted;
+};
+
+static int compare_prop(const void *a, const void *b)
+{
+    struct m_property *pa = *(struct m_property **)a;
+    struct m_property *pb = *(struct m_property **)b;
+    int r = strcmp(pa->name, pb->name);
+    return r ? r : (pa > pb) - (pa < pb);
+}
+
+struct m_property_list *m_property_list_create(void *ta_parent,
+                                               struct m_property *props)
+{
+    struct m_property_list *list = talloc_zero(ta_parent, struct m_property_list);
+    list->props = props;
+    while (props[list->num_props].name)
+        list->num_props++;
+    list->sorted = talloc_array(list, struct m_property *, list->num_props);
+    for (int n = 0; n < list->num_props; n++)
+        list->sorted[n] = &props[n];
+    qsort(list->sorted, list->num_props, sizeof(list->sorted[0]), compare_prop);
+    return list;
+}
+
+// Like strcmp(), but name is not necessarily 0-terminated.
+static int compare_name(bstr name, const char *s)
+{
+    int r = strncmp(name.start, s, name.len);
+    if (r)
+        return r;
+    return s[name.len] ? -1 : 0;
+}
+
+static struct m_property *find_property(const struct m_property_list *list,
+                                        bstr name)
 {
-    for (int n = 0; list && list[n].name; n++) {
-        if (strcmp(list[n].name, name) == 0)
-            return (struct m_property *)&list[n];
+    if (!list)
+        return NULL;
+    // Find the first entry that is not smaller than name. If there are
+    // duplicates, this returns the one that comes first in the list.
+    int lo = 0, hi = list->num_props;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (compare_name(name, list->sorted[mid]->name) > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
+    if (lo < list->num_props && compare_name(name, list->sorted[lo]->name) == 0)
+        return list->sorted[lo];
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
+struct m_property *m_property_list_find(const struct m_property_list *list,
+                                        const char *name)
+{
+    return find_property(list, bstr0(name));
+}
+
+static int do_action(const struct m_property_list *prop_list, const char *name,
                      int action, void *arg, void *ctx)
 {
     struct m_property *prop;
     struct m_property_action_arg ka;
     const char *sep = strchr(name, '/');
     if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+        prop = find_property(prop_list, (bstr){(char *)name, sep - name});
         ka = (struct m_property_action_arg) {
             .key = sep + 1,
             .action = action,
@@ -88,14 +141,14 @@ static int do_action(const struct m_property *prop_list, const char *name,
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
     } else
-        prop = m_property_list_find(prop_list, name);
+        prop = find_property(prop_list, bstr0(name));
     if (!prop)
         return M_PROPERTY_UNKNOWN;
     return prop->call(ctx, prop, action, arg);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_list *prop_list,
                   const char *name, int action, void *arg, void *ctx)
 {
     union m_option_value val = m_option_value_default;
@@ -235,7 +288,7 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property_list *prop_list, bstr name,
                               int action, void *arg, void *ctx)
 {
     char *name0 = bstrdup0(NULL, name);
@@ -252,7 +305,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_list *prop_list, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -285,7 +338,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_list *prop_list,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -350,13 +403,13 @@ char *m_properties_expand_string(const struct m_property *prop_list,
 }
 
 void m_properties_print_help_list(struct mp_log *log,
-                                  const struct m_property *list)
+                                  const struct m_property_list *list)
 {
     int count = 0;
 
     mp_info(log, "Name\n\n");
-    for (int i = 0; list[i].name; i++) {
-        const struct m_property *p = &list[i];
+    for (int i = 0; i < list->num_props; i++) {
+        const struct m_property *p = &list->props[i];
         mp_info(log, " %s\n", p->name);
         count++;
     }
@@ -97,6 +97,13 @@ enum mp_property_action {
     // Most properties do not implement this.
     //  arg: (ignored)
     M_PROPERTY_DELETE,
+
+    // Get a counter that changes whenever the value may have changed. If it
+    // is the same as on a previous call, the value (and the values of all
+    // sub-properties) is still the same, and does not need to be read again.
+    // Most properties do not implement this.
+    //  arg: uint64_t*
+    M_PROPERTY_GET_GENERATION,
 };
 
 // Argument for M_PROPERTY_SWITCH
@@ -151,14 +158,22 @@ struct m_property {
     bool coalesce;
 };
 
-struct m_property *m_property_list_find(const struct m_property *list,
+// A list of properties, indexed for lookup by name.
+struct m_property_list;
+
+// props is terminated with a {0} item. It is not copied, and must not be
+// changed while the returned list exists (except for the coalesce fields).
+struct m_property_list *m_property_list_create(void *ta_parent,
+                                               struct m_property *props);
+
+struct m_property *m_property_list_find(const struct m_property_list *list,
                                         const char *name);
 
 // Access a property.
 // action: one of m_property_action
 // ctx: opaque value passed through to property implementation
 // returns: one of mp_property_return
-int m_property_do(struct mp_log *log, const struct m_property* prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_list *prop_list,
                   const char* property_name, int action, void* arg, void *ctx);
 
 // Given a path of the form "a/b/c", this function will set *prefix to "a",
@@ -169,7 +184,7 @@ bool m_property_split_path(const char *path, bstr *prefix, char **rem);
 
 // Print a list of properties.
 void m_properties_print_help_list(struct mp_log *log,
-                                  const struct m_property *list);
+                                  const struct m_property_list *list);
 
 // Expand a property string.
 // This function allows to print strings containing property values.
@@ -183,7 +198,7 @@ void m_properties_print_help_list(struct mp_log *log,
 // STR is recursively expanded using the same rules.
 // "$$" can be used to escape "$", and "$}" to escape "}".
 // "$>" disables parsing of "$" for the rest of the string.
-char* m_properties_expand_string(const struct m_property *prop_list,
+char* m_properties_expand_string(const struct m_property_list *prop_list,
                                  const char *str, void *ctx);
 
 // Trivial helpers for implementing properties.
@@ -62,6 +62,7 @@ extern const struct m_sub_options stream_bluray_conf;
 extern const struct m_sub_options stream_cdda_conf;
 extern const struct m_sub_options stream_dvb_conf;
 extern const struct m_sub_options stream_lavf_conf;
+extern const struct m_sub_options stream_file_conf;
 extern const struct m_sub_options sws_conf;
 extern const struct m_sub_options zimg_conf;
 extern const struct m_sub_options drm_conf;
@@ -901,6 +902,7 @@ static const m_option_t mp_opts[] = {
 
     {"input-ipc-server", OPT_STRING(ipc_path), .flags = M_OPT_FILE},
     {"input-ipc-client", OPT_STRING(ipc_client)},
+    {"input-ipc-single-thread", OPT_BOOL(ipc_single_thread)},
 
     {"screenshot", OPT_SUBSTRUCT(screenshot_image_opts, screenshot_conf)},
     {"screenshot-template", OPT_STRING(screenshot_template)},
@@ -908,6 +910,8 @@ static const m_option_t mp_opts[] = {
         .flags = M_OPT_FILE},
     {"screenshot-directory", OPT_ALIAS("screenshot-dir")},
     {"screenshot-sw", OPT_BOOL(screenshot_sw)},
+    {"screenshot-max-pending", OPT_INT(screenshot_max_pending),
+        M_RANGE(1, 64)},
 
     {"", OPT_SUBSTRUCT(resample_opts, resample_conf)},
 
@@ -919,6 +923,7 @@ static const m_option_t mp_opts[] = {
     {"", OPT_SUBSTRUCT(demux_opts, demux_conf)},
     {"", OPT_SUBSTRUCT(demux_cache_opts, demux_cache_conf)},
     {"", OPT_SUBSTRUCT(stream_opts, stream_conf)},
+    {"", OPT_SUBSTRUCT(stream_file_opts, stream_file_conf)},
 
     {"", OPT_SUBSTRUCT(ra_ctx_opts, ra_ctx_conf)},
     {"", OPT_SUBSTRUCT(gl_video_opts, gl_video_conf)},
@@ -1067,6 +1072,7 @@ static const struct MPOpts mp_default_opts = {
     .audiofile_auto = -1,
     .osd_bar_visible = true,
     .screenshot_template = "mpv-shot%n",
+    .screenshot_max_pending = 4,
     .play_dir = 1,
     .media_controls = true,
     .video_exts = (char *[]){
@@ -331,6 +331,7 @@ typedef struct MPOpts {
     char *screenshot_template;
     char *screenshot_dir;
     bool screenshot_sw;
+    int screenshot_max_pending;
 
     struct m_channels audio_output_channels;
     int audio_output_format;
@@ -378,6 +379,7 @@ typedef struct MPOpts {
     struct demux_opts *demux_opts;
     struct demux_cache_opts *demux_cache_opts;
     struct stream_opts *stream_opts;
+    struct stream_file_opts *stream_file_opts;
 
     struct vd_lavc_params *vd_lavc_params;
     struct ad_lavc_params *ad_lavc_params;
@@ -392,6 +394,7 @@ typedef struct MPOpts {
 
     char *ipc_path;
     char *ipc_client;
+    bool ipc_single_thread;
 
     struct mp_resample_opts *resample_opts;
 
@@ -92,14 +92,18 @@ struct observe_property {
     int64_t reply_id;
     mpv_format format;
     const struct m_option *type;
+    bool diff;              // report changes as node_array_diff() result
     // -- protected by owner->lock
     size_t refcount;
     uint64_t change_ts;     // logical timestamp incremented on each change
     uint64_t value_ts;      // logical timestamp for value contents
     bool value_valid;
     union m_option_value value;
+    bool gen_valid;         // gen was returned with value
+    uint64_t gen;           // M_PROPERTY_GET_GENERATION result
     uint64_t value_ret_ts;  // logical timestamp of value returned to user
     union m_option_value value_ret;
+    union m_option_value value_sent; // last full value for diff mode
     bool waiting_for_hook;  // flag for draining old property changes on a hook
 };
 
@@ -112,9 +116,10 @@ struct mpv_handle {
     int64_t id;
 
     // -- not thread-safe
-    struct mpv_event *cur_event;
-    struct mpv_event_property cur_property_event;
-    struct observe_property *cur_property;
+    void *cur_event_data;   // talloc parent of data of returned events
+    struct mpv_event *cur_events; // events returned by mpv_wait_events()
+    struct mpv_event_property *cur_property_events; // data for cur_events
+    int max_cur_events;     // allocated number of entries in cur_events
 
     mp_mutex lock;
 
@@ -139,11 +144,15 @@ struct mpv_handle {
     int reserved_events;    // number of entries reserved for replies
     size_t async_counter;   // pending other async events
     bool choked;            // recovering from queue overflow
+    uint64_t num_overflows; // number of times the queue overflowed
+    uint64_t num_dropped;   // number of events dropped due to overflows
     bool destroying;        // pending destruction; no API accesses allowed
     bool hook_pending;      // hook events are returned after draining properties
 
     struct observe_property **properties;
     int num_properties;
+    struct observe_property **cur_properties; // referenced by cur_events
+    int num_cur_properties;
     bool has_pending_properties; // (maybe) new property events (producer side)
     bool new_property_events; // new property events (consumer side)
     int cur_property_index; // round-robin for property events (consumer side)
@@ -160,8 +169,11 @@ struct mpv_handle {
     int messages_level;
 };
 
-static bool gen_log_message_event(struct mpv_handle *ctx);
-static bool gen_property_change_event(struct mpv_handle *ctx);
+static bool gen_log_message_event(struct mpv_handle *ctx,
+                                  struct mpv_event *event);
+static bool gen_property_change_event(struct mpv_handle *ctx,
+                                      struct mpv_event *event,
+                                      struct mpv_event_property *prop_event);
 static void notify_property_events(struct mpv_handle *ctx, int event);
 
 // Must be called with prop->owner->lock held.
@@ -288,7 +300,10 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
         .mpctx = clients->mpctx,
         .clients = clients,
         .id = ++(clients->id_alloc),
-        .cur_event = talloc_zero(client, struct mpv_event),
+        .cur_event_data = talloc_new(client),
+        .cur_events = talloc_zero(client, struct mpv_event),
+        .cur_property_events = talloc_zero(client, struct mpv_event_property),
+        .max_cur_events = 1,
         .events = talloc_array(client, mpv_event, num_events),
         .max_events = num_events,
         .event_mask = (1ULL << INTERNAL_EVENT_BASE) - 1, // exclude internal events
@@ -443,8 +458,9 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
     ctx->num_properties = 0;
     ctx->properties_change_ts += 1;
 
-    prop_unref(ctx->cur_property);
-    ctx->cur_property = NULL;
+    for (int n = 0; n < ctx->num_cur_properties; n++)
+        prop_unref(ctx->cur_properties[n]);
+    ctx->num_cur_properties = 0;
 
     mp_mutex_unlock(&ctx->lock);
 
@@ -738,11 +754,14 @@ static int send_event(struct mpv_handle *ctx, struct mpv_event *event, bool copy
         r = 0;
     } else if (ctx->choked) {
         r = -1;
+        ctx->num_dropped++;
     } else {
         r = append_event(ctx, *event, copy);
         if (r < 0) {
             MP_ERR(ctx, "Too many events queued.\n");
             ctx->choked = true;
+            ctx->num_overflows++;
+            ctx->num_dropped++;
         }
     }
     mp_mutex_unlock(&ctx->lock);
@@ -889,10 +908,50 @@ static bool check_for_for_hook_flags(mpv_handle *ctx)
     return false;
 }
 
-mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
+// Set *event to the next event, or return false if there is none.
+static bool get_next_event(struct mpv_handle *ctx, struct mpv_event *event,
+                           struct mpv_event_property *prop_event)
 {
-    mpv_event *event = ctx->cur_event;
+    // Recover from overflow.
+    if (ctx->choked && !ctx->num_events) {
+        ctx->choked = false;
+        *event = (struct mpv_event){.event_id = MPV_EVENT_QUEUE_OVERFLOW};
+        return true;
+    }
+    struct mpv_event *ev =
+        ctx->num_events ? &ctx->events[ctx->first_event] : NULL;
+    if (ev && ev->event_id == MPV_EVENT_HOOK) {
+        // Give old property notifications priority over hooks. This is a
+        // guarantee given to clients to simplify their logic. New property
+        // changes after this are treated normally, so
+        if (!ctx->hook_pending) {
+            ctx->hook_pending = true;
+            set_wait_for_hook_flags(ctx);
+        }
+        if (check_for_for_hook_flags(ctx)) {
+            ev = NULL; // delay
+        } else {
+            ctx->hook_pending = false;
+        }
+    }
+    if (ev) {
+        *event = *ev;
+        ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
+        ctx->num_events--;
+        talloc_steal(ctx->cur_event_data, event->data);
+        return true;
+    }
+    // If there's a changed property, generate change event (never queued).
+    if (gen_property_change_event(ctx, event, prop_event))
+        return true;
+    // Pop item from message queue, and return as event.
+    return gen_log_message_event(ctx, event);
+}
 
+// Wait for events like mpv_wait_event(), and return up to max_events of them
+// in ctx->cur_events. Returns the number of events; 0 on timeout.
+static int wait_events(struct mpv_handle *ctx, int max_events, double timeout)
+{
     mp_mutex_lock(&ctx->lock);
 
     if (!ctx->fuzzy_initialized)
@@ -904,46 +963,31 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
 
     int64_t deadline = mp_time_ns_add(mp_time_ns(), timeout);
 
-    *event = (mpv_event){0};
-    talloc_free_children(event);
+    // Release everything referenced by the previously returned events.
+    talloc_free_children(ctx->cur_event_data);
+    for (int n = 0; n < ctx->num_cur_properties; n++)
+        prop_unref(ctx->cur_properties[n]);
+    ctx->num_cur_properties = 0;
+
+    if (max_events > ctx->max_cur_events) {
+        ctx->cur_events =
+            talloc_realloc(ctx, ctx->cur_events, struct mpv_event, max_events);
+        ctx->cur_property_events =
+            talloc_realloc(ctx, ctx->cur_property_events,
+                           struct mpv_event_property, max_events);
+        ctx->max_cur_events = max_events;
+    }
+    ctx->cur_events[0] = (struct mpv_event){0};
 
+    int num = 0;
     while (1) {
         if (ctx->queued_wakeup)
             deadline = 0;
-        // Recover from overflow.
-        if (ctx->choked && !ctx->num_events) {
-            ctx->choked = false;
-            event->event_id = MPV_EVENT_QUEUE_OVERFLOW;
-            break;
-        }
-        struct mpv_event *ev =
-            ctx->num_events ? &ctx->events[ctx->first_event] : NULL;
-        if (ev && ev->event_id == MPV_EVENT_HOOK) {
-            // Give old property notifications priority over hooks. This is a
-            // guarantee given to clients to simplify their logic. New property
-            // changes after this are treated normally, so
-            if (!ctx->hook_pending) {
-                ctx->hook_pending = true;
-                set_wait_for_hook_flags(ctx);
-            }
-            if (check_for_for_hook_flags(ctx)) {
-                ev = NULL; // delay
-            } else {
-                ctx->hook_pending = false;
-            }
-        }
-        if (ev) {
-            *event = *ev;
-            ctx->first_event = (ctx->first_event + 1) % ctx->max_events;
-            ctx->num_events--;
-            talloc_steal(event, event->data);
-            break;
-        }
-        // If there's a changed property, generate change event (never queued).
-        if (gen_property_change_event(ctx))
-            break;
-        // Pop item from message queue, and return as event.
-        if (gen_log_message_event(ctx))
+        while (num < max_events &&
+               get_next_event(ctx, &ctx->cur_events[num],
+                              &ctx->cur_property_events[num]))
+            num++;
+        if (num)
             break;
         int r = wait_wakeup(ctx, deadline);
         if (r == ETIMEDOUT)
@@ -953,7 +997,63 @@ mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
 
     mp_mutex_unlock(&ctx->lock);
 
-    return event;
+    return num;
+}
+
+mpv_event *mpv_wait_event(mpv_handle *ctx, double timeout)
+{
+    wait_events(ctx, 1, timeout);
+    return &ctx->cur_events[0];
+}
+
+int mpv_wait_events(mpv_handle *ctx, mpv_event **events, int max_events,
+                    double timeout)
+{
+    if (max_events < 1)
+        return MPV_ERROR_INVALID_PARAMETER;
+    // There can't be many more events ready than fit into the queue, so
+    // don't allocate more space than that.
+    mp_mutex_lock(&ctx->lock);
+    int limit = ctx->max_events + ctx->num_properties + 1;
+    mp_mutex_unlock(&ctx->lock);
+    int num = wait_events(ctx, MPMIN(max_events, limit), timeout);
+    *events = ctx->cur_events;
+    return num;
+}
+
+int mpv_set_event_queue_size(mpv_handle *ctx, int num_events)
+{
+    if (num_events < 1)
+        return MPV_ERROR_INVALID_PARAMETER;
+
+    int r = 0;
+    mp_mutex_lock(&ctx->lock);
+    if (num_events < ctx->num_events + ctx->reserved_events) {
+        r = MPV_ERROR_EVENT_QUEUE_FULL;
+    } else {
+        struct mpv_event *events = talloc_array(ctx, mpv_event, num_events);
+        for (int n = 0; n < ctx->num_events; n++)
+            events[n] = ctx->events[(ctx->first_event + n) % ctx->max_events];
+        talloc_free(ctx->events);
+        ctx->events = events;
+        ctx->max_events = num_events;
+        ctx->first_event = 0;
+    }
+    mp_mutex_unlock(&ctx->lock);
+    return r;
+}
+
+int mpv_get_event_queue_stats(mpv_handle *ctx, mpv_node *stats)
+{
+    mp_mutex_lock(&ctx->lock);
+    node_init(stats, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(stats, "queued", ctx->num_events);
+    node_map_add_int64(stats, "queue-size", ctx->max_events);
+    node_map_add_flag(stats, "choked", ctx->choked);
+    node_map_add_int64(stats, "overflows", ctx->num_overflows);
+    node_map_add_int64(stats, "dropped", ctx->num_dropped);
+    mp_mutex_unlock(&ctx->lock);
+    return 0;
 }
 
 void mpv_wakeup(mpv_handle *ctx)
@@ -1530,11 +1630,12 @@ static void property_free(void *p)
     if (prop->type) {
         m_option_free(prop->type, &prop->value);
         m_option_free(prop->type, &prop->value_ret);
+        m_option_free(prop->type, &prop->value_sent);
     }
 }
 
-int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
-                         const char *name, mpv_format format)
+static int observe_property(mpv_handle *ctx, uint64_t userdata,
+                            const char *name, mpv_format format, bool diff)
 {
     const struct m_option *type = get_mp_type_get(format);
     if (format != MPV_FORMAT_NONE && !type)
@@ -1555,10 +1656,12 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .reply_id = userdata,
         .format = format,
         .type = type,
+        .diff = diff,
         .change_ts = 1, // force initial event
         .refcount = 1,
         .value = m_option_value_default,
         .value_ret = m_option_value_default,
+        .value_sent = m_option_value_default,
     };
     ctx->properties_change_ts += 1;
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
@@ -1571,6 +1674,18 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     return 0;
 }
 
+int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
+                         const char *name, mpv_format format)
+{
+    return observe_property(ctx, userdata, name, format, false);
+}
+
+int mpv_observe_property_diff(mpv_handle *ctx, uint64_t userdata,
+                              const char *name)
+{
+    return observe_property(ctx, userdata, name, MPV_FORMAT_NODE, true);
+}
+
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
     mp_mutex_lock(&ctx->lock);
@@ -1693,10 +1808,19 @@ static void send_client_property_changes(struct mpv_handle *ctx)
             // thing is that property getters can do whatever they want, _and_
             // that they may wait on the client API user thread (if vo_libmpv
             // or similar things are involved).
+            // If the property has a generation counter, and it did not change
+            // since the last read, skip the (possibly expensive) getter.
+            bool had_gen = prop->gen_valid && prop->value_ts;
+            uint64_t old_gen = prop->gen;
             prop->refcount += 1; // keep prop alive (esp. prop->name)
             ctx->async_counter += 1; // keep ctx alive
             mp_mutex_unlock(&ctx->lock);
-            getproperty_fn(&req);
+            uint64_t gen = 0;
+            bool gen_valid = mp_property_do(prop->name, M_PROPERTY_GET_GENERATION,
+                                            &gen, ctx->mpctx) == M_PROPERTY_OK;
+            bool unchanged = gen_valid && had_gen && gen == old_gen;
+            if (!unchanged)
+                getproperty_fn(&req);
             mp_mutex_lock(&ctx->lock);
             ctx->async_counter -= 1;
             prop_unref(prop);
@@ -1711,19 +1835,24 @@ static void send_client_property_changes(struct mpv_handle *ctx)
             }
             mp_assert(prop->refcount > 0);
 
-            bool val_valid = req.status >= 0;
-            changed = prop->value_valid != val_valid;
-            if (prop->value_valid && val_valid)
-                changed = !equal_mpv_value(&prop->value, &val, prop->format);
-            if (prop->value_ts == 0)
-                changed = true; // initial event
-
-            prop->value_valid = val_valid;
-            if (changed && val_valid) {
-                // move val to prop->value
-                m_option_free(type, &prop->value);
-                memcpy(&prop->value, &val, type->type->size);
-                memset(&val, 0, type->type->size);
+            prop->gen_valid = gen_valid;
+            prop->gen = gen;
+
+            if (!unchanged) {
+                bool val_valid = req.status >= 0;
+                changed = prop->value_valid != val_valid;
+                if (prop->value_valid && val_valid)
+                    changed = !equal_mpv_value(&prop->value, &val, prop->format);
+                if (prop->value_ts == 0)
+                    changed = true; // initial event
+
+                prop->value_valid = val_valid;
+                if (changed && val_valid) {
+                    // move val to prop->value
+                    m_option_free(type, &prop->value);
+                    memcpy(&prop->value, &val, type->type->size);
+                    memset(&val, 0, type->type->size);
+                }
             }
 
             m_option_free(prop->type, &val);
@@ -1780,9 +1909,37 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
     mp_mutex_unlock(&clients->lock);
 }
 
-// Set ctx->cur_event to a generated property change event, if there is any
-// outstanding property.
-static bool gen_property_change_event(struct mpv_handle *ctx)
+// Set prop->value_ret to the changes between the value last returned to the
+// user and the current value. Falls back to returning the full value if there
+// is no previous value, or if the changes would not be any smaller.
+static void gen_property_diff(struct observe_property *prop)
+{
+    struct mpv_node *old = (struct mpv_node *)&prop->value_sent;
+    struct mpv_node *new = (struct mpv_node *)&prop->value;
+
+    struct mpv_node changes;
+    node_init(&changes, MPV_FORMAT_NODE_ARRAY, NULL);
+    bool use_diff = old->format == MPV_FORMAT_NODE_ARRAY &&
+                    new->format == MPV_FORMAT_NODE_ARRAY &&
+                    node_array_diff(&changes, old, new) &&
+                    changes.u.list->num < new->u.list->num;
+
+    struct mpv_node res;
+    node_init(&res, MPV_FORMAT_NODE_MAP, NULL);
+    *node_map_add(&res, use_diff ? "changes" : "value", MPV_FORMAT_NONE) =
+        use_diff ? changes : *new;
+    m_option_copy(prop->type, &prop->value_ret, &res);
+    talloc_free(res.u.list);
+    talloc_free(changes.u.list);
+
+    m_option_copy(prop->type, &prop->value_sent, &prop->value);
+}
+
+// Set *event to a generated property change event, if there is any
+// outstanding property. prop_event is used as event data.
+static bool gen_property_change_event(struct mpv_handle *ctx,
+                                      struct mpv_event *event,
+                                      struct mpv_event_property *prop_event)
 {
     if (!ctx->mpctx->initialized)
         return false;
@@ -1803,22 +1960,28 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
         {
             prop->value_ret_ts = prop->value_ts;
             prop->waiting_for_hook = false;
-            prop_unref(ctx->cur_property);
-            ctx->cur_property = prop;
+            MP_TARRAY_APPEND(ctx, ctx->cur_properties, ctx->num_cur_properties,
+                             prop);
             prop->refcount += 1;
 
-            if (prop->value_valid)
+            if (prop->value_valid && prop->diff) {
+                gen_property_diff(prop);
+            } else if (prop->value_valid) {
                 m_option_copy(prop->type, &prop->value_ret, &prop->value);
+            } else if (prop->diff) {
+                // Send the full value once it becomes available again.
+                m_option_free(prop->type, &prop->value_sent);
+            }
 
-            ctx->cur_property_event = (struct mpv_event_property){
+            *prop_event = (struct mpv_event_property){
                 .name = prop->name,
                 .format = prop->value_valid ? prop->format : 0,
                 .data = prop->value_valid ? &prop->value_ret : NULL,
             };
-            *ctx->cur_event = (struct mpv_event){
+            *event = (struct mpv_event){
                 .event_id = MPV_EVENT_PROPERTY_CHANGE,
                 .reply_userdata = prop->reply_id,
-                .data = &ctx->cur_property_event,
+                .data = prop_event,
             };
             return true;
         }
@@ -1903,15 +2066,16 @@ int mpv_request_log_messages(mpv_handle *ctx, const char *min_level)
     return 0;
 }
 
-// Set ctx->cur_event to a generated log message event, if any available.
-static bool gen_log_message_event(struct mpv_handle *ctx)
+// Set *event to a generated log message event, if any available.
+static bool gen_log_message_event(struct mpv_handle *ctx,
+                                  struct mpv_event *event)
 {
     if (ctx->messages) {
         struct mp_log_buffer_entry *msg =
             mp_msg_log_buffer_read(ctx->messages);
         if (msg) {
             struct mpv_event_log_message *cmsg =
-                talloc_ptrtype(ctx->cur_event, cmsg);
+                talloc_ptrtype(ctx->cur_event_data, cmsg);
             talloc_steal(cmsg, msg);
             *cmsg = (struct mpv_event_log_message){
                 .prefix = msg->prefix,
@@ -1919,7 +2083,7 @@ static bool gen_log_message_event(struct mpv_handle *ctx)
                 .log_level = mp_mpv_log_levels[msg->level],
                 .text = msg->text,
             };
-            *ctx->cur_event = (struct mpv_event){
+            *event = (struct mpv_event){
                 .event_id = MPV_EVENT_LOG_MESSAGE,
                 .data = cmsg,
             };
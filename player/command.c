@@ -88,6 +88,8 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    // Lookup index for properties.
+    struct m_property_list *prop_list;
 
     double last_seek_time;
     double last_seek_pts;
@@ -122,6 +124,13 @@ struct command_ctx {
     int hwdec_osd_mode;
 
     double cached_window_scale;
+
+    // Incremented on changes to the "playlist" and "track-list" properties.
+    uint64_t playlist_gen;
+    uint64_t tracks_gen;
+    // Ids of the current and playing playlist entries (0 if none) the
+    // playlist_gen value was last returned for.
+    int64_t playlist_gen_current, playlist_gen_playing;
 };
 
 static const struct m_option script_props_type = {
@@ -2160,10 +2169,26 @@ static char *append_track_info(char *res, struct track *track)
     return res;
 }
 
+// Handle M_PROPERTY_GET_GENERATION for a property and its sub-properties.
+static bool property_generation(int action, void *arg, uint64_t gen)
+{
+    if (action == M_PROPERTY_KEY_ACTION) {
+        struct m_property_action_arg *ka = arg;
+        action = ka->action;
+        arg = ka->arg;
+    }
+    if (action != M_PROPERTY_GET_GENERATION)
+        return false;
+    *(uint64_t *)arg = gen;
+    return true;
+}
+
 static int mp_property_list_tracks(void *ctx, struct m_property *prop,
                                    int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    if (property_generation(action, arg, mpctx->command_ctx->tracks_gen))
+        return M_PROPERTY_OK;
     if (action == M_PROPERTY_PRINT) {
         char *res = talloc_strdup(NULL, "");
 
@@ -3493,10 +3518,31 @@ static int mp_property_playlist_path(void *ctx, struct m_property *prop,
     return m_property_strdup_ro(action, arg, e->playlist_path);
 }
 
+// The current and playing entries change in many places (loadfile.c,
+// playlist.c), not all of which send an event for it, so compare them with
+// the state the generation was last returned for.
+static uint64_t playlist_generation(struct MPContext *mpctx)
+{
+    struct command_ctx *ctx = mpctx->command_ctx;
+    struct playlist_entry *cur = mpctx->playlist->current;
+    int64_t current = cur ? cur->id : 0;
+    int64_t playing = mpctx->playing ? mpctx->playing->id : 0;
+    if (current != ctx->playlist_gen_current ||
+        playing != ctx->playlist_gen_playing)
+    {
+        ctx->playlist_gen_current = current;
+        ctx->playlist_gen_playing = playing;
+        ctx->playlist_gen++;
+    }
+    return ctx->playlist_gen;
+}
+
 static int mp_property_playlist(void *ctx, struct m_property *prop,
                                 int action, void *arg)
 {
     MPContext *mpctx = ctx;
+    if (property_generation(action, arg, playlist_generation(mpctx)))
+        return M_PROPERTY_OK;
     if (action == M_PROPERTY_PRINT) {
         struct playlist *pl = mpctx->playlist;
         char *res = talloc_strdup(NULL, "");
@@ -4694,7 +4740,7 @@ int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do(ctx->log, cmd->prop_list, name, action, val, ctx);
 
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
         struct m_option option_type = {0};
@@ -4719,7 +4765,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->prop_list, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -4746,7 +4792,7 @@ char *mp_property_expand_escaped_string(struct MPContext *mpctx, const char *str
 void property_print_help(struct MPContext *mpctx)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    m_properties_print_help_list(mpctx->log, ctx->properties);
+    m_properties_print_help_list(mpctx->log, ctx->prop_list);
 }
 
 /* List of default ways to show a property on OSD.
@@ -5323,7 +5369,7 @@ static void change_property_cmd(struct mp_cmd_ctx *cmd,
     struct m_property *prop = NULL;
     if (cmd->cmd->coalesce) {
         struct command_ctx *ctx = cmd->mpctx->command_ctx;
-        prop = m_property_list_find(ctx->properties, name);
+        prop = m_property_list_find(ctx->prop_list, name);
         if (prop)
             prop->coalesce = true;
     }
@@ -7727,6 +7773,8 @@ void command_init(struct MPContext *mpctx)
         ctx->properties[count++] = prop;
     }
 
+    ctx->prop_list = m_property_list_create(ctx, ctx->properties);
+
     node_init(&ctx->mdata, MPV_FORMAT_NODE_ARRAY, NULL);
     talloc_steal(ctx, ctx->mdata.u.list);
 
@@ -7739,6 +7787,31 @@ static void command_event(struct MPContext *mpctx, int event, void *arg)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
 
+    // These must cover all events that list the properties (or "*") in
+    // mp_event_property_change[]. The other "*" events do not affect them,
+    // and are skipped. Direct notifications are handled in
+    // mp_notify_property().
+    switch (event) {
+    case MPV_EVENT_START_FILE:
+    case MPV_EVENT_END_FILE:
+    case MP_EVENT_CHANGE_ALL:
+    case MP_EVENT_CHANGE_PLAYLIST:
+        ctx->playlist_gen++;
+        break;
+    }
+    switch (event) {
+    case MPV_EVENT_START_FILE:
+    case MPV_EVENT_END_FILE:
+    case MPV_EVENT_FILE_LOADED:
+    case MP_EVENT_CHANGE_ALL:
+    case MPV_EVENT_VIDEO_RECONFIG:
+    case MPV_EVENT_AUDIO_RECONFIG:
+    case MP_EVENT_TRACKS_CHANGED:
+    case MP_EVENT_TRACK_SWITCHED:
+        ctx->tracks_gen++;
+        break;
+    }
+
     if (event == MPV_EVENT_START_FILE) {
         ctx->last_seek_pts = MP_NOPTS_VALUE;
         ctx->marked_pts = MP_NOPTS_VALUE;
@@ -7944,7 +8017,9 @@ void mp_option_run_callback(struct MPContext *mpctx, struct mp_option_callback *
     if (flags & UPDATE_SUB_EXTS)
         mp_update_subtitle_exts(mpctx->opts);
 
-    if (opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client) {
+    if (opt_ptr == &opts->ipc_path || opt_ptr == &opts->ipc_client ||
+        opt_ptr == &opts->ipc_single_thread)
+    {
         mp_uninit_ipc(mpctx->ipc_ctx);
         mpctx->ipc_ctx = mp_init_ipc(mpctx->clients, mpctx->global);
     }
@@ -8134,5 +8209,13 @@ void mp_option_run_callback(struct MPContext *mpctx, struct mp_option_callback *
 
 void mp_notify_property(struct MPContext *mpctx, const char *property)
 {
+    struct command_ctx *ctx = mpctx->command_ctx;
+
+    // This bypasses command_event(), so update the generations here.
+    if (match_property(property, "playlist"))
+        ctx->playlist_gen++;
+    if (match_property(property, "track-list"))
+        ctx->tracks_gen++;
+
     mp_client_property_change(mpctx, property);
 }
@@ -22,6 +22,7 @@
 #include <libavcodec/avcodec.h>
 
 #include "osdep/io.h"
+#include "osdep/threads.h"
 
 #include "mpv_talloc.h"
 #include "screenshot.h"
@@ -31,7 +32,6 @@
 #include "misc/bstr.h"
 #include "misc/dispatch.h"
 #include "misc/node.h"
-#include "misc/thread_tools.h"
 #include "common/msg.h"
 #include "options/path.h"
 #include "video/mp_image.h"
@@ -56,8 +56,28 @@ typedef struct screenshot_ctx {
 
     int frameno;
     uint64_t last_frame_count;
+
+    // Number of screenshots currently being encoded/written. Protected by the
+    // core lock; changes are signaled with write_wakeup.
+    int pending_writes;
+    // Number of each-frame screenshot commands that have not completed yet.
+    int each_frame_pending;
+    // Sequence number of the each-frame screenshot that has not grabbed its
+    // frame yet, or 0.
+    uintptr_t each_frame_capture;
+    uintptr_t each_frame_seq;
+
+    mp_mutex write_lock;
+    mp_cond write_wakeup;
 } screenshot_ctx;
 
+static void screenshot_destroy(void *p)
+{
+    screenshot_ctx *ctx = p;
+    mp_cond_destroy(&ctx->write_wakeup);
+    mp_mutex_destroy(&ctx->write_lock);
+}
+
 void screenshot_init(struct MPContext *mpctx)
 {
     mpctx->screenshot_ctx = talloc(mpctx, screenshot_ctx);
@@ -66,6 +86,9 @@ void screenshot_init(struct MPContext *mpctx)
         .frameno = 1,
         .log = mp_log_new(mpctx, mpctx->log, "screenshot")
     };
+    mp_mutex_init(&mpctx->screenshot_ctx->write_lock);
+    mp_cond_init(&mpctx->screenshot_ctx->write_wakeup);
+    talloc_set_destructor(mpctx->screenshot_ctx, screenshot_destroy);
 }
 
 static char *stripext(void *talloc_ctx, const char *s)
@@ -81,17 +104,34 @@ static bool write_screenshot(struct mp_cmd_ctx *cmd, struct mp_image *img,
                              bool overwrite)
 {
     struct MPContext *mpctx = cmd->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
     struct image_writer_opts *gopts = mpctx->opts->screenshot_image_opts;
     struct image_writer_opts opts_copy = opts ? *opts : *gopts;
 
+    // Wait until a write slot is free. This runs on the command's own thread
+    // with the core locked, so unlock it while waiting.
+    while (ctx->pending_writes >= mpctx->opts->screenshot_max_pending) {
+        mp_mutex_lock(&ctx->write_lock);
+        mp_core_unlock(mpctx);
+        mp_cond_wait(&ctx->write_wakeup, &ctx->write_lock);
+        mp_mutex_unlock(&ctx->write_lock);
+        mp_core_lock(mpctx);
+    }
+
     mp_cmd_msg(cmd, MSGL_V, "Starting screenshot: '%s'", filename);
 
+    ctx->pending_writes++;
     mp_core_unlock(mpctx);
 
     bool ok = img && write_image(img, &opts_copy, filename, mpctx->global,
-                                 mpctx->screenshot_ctx->log, overwrite);
+                                 ctx->log, overwrite);
 
     mp_core_lock(mpctx);
+    ctx->pending_writes--;
+    mp_mutex_lock(&ctx->write_lock);
+    mp_cond_broadcast(&ctx->write_wakeup);
+    mp_mutex_unlock(&ctx->write_lock);
+    mp_wakeup_core(mpctx);
 
     if (ok) {
         mp_cmd_msg(cmd, MSGL_INFO, "Screenshot: '%s'", filename);
@@ -539,6 +579,14 @@ void cmd_screenshot(void *p)
 
     struct mp_image *image = screenshot_get(mpctx, mode, high_depth);
 
+    // The frame was grabbed; the playloop can continue while it is written.
+    if (each_frame_mode &&
+        ctx->each_frame_capture == (uintptr_t)cmd->on_completion_priv)
+    {
+        ctx->each_frame_capture = 0;
+        mp_wakeup_core(mpctx);
+    }
+
     if (image) {
         char *filename = gen_fname(cmd, image_writer_file_ext(opts));
         if (filename) {
@@ -591,11 +639,14 @@ void cmd_screenshot_raw(void *p)
 
 static void screenshot_fin(struct mp_cmd_ctx *cmd)
 {
-    void **a = cmd->on_completion_priv;
-    struct MPContext *mpctx = a[0];
-    struct mp_waiter *waiter = a[1];
+    struct MPContext *mpctx = cmd->mpctx;
+    screenshot_ctx *ctx = mpctx->screenshot_ctx;
 
-    mp_waiter_wakeup(waiter, 0);
+    // In case the command failed before getting to take the screenshot. Don't
+    // touch the state of a later each-frame screenshot.
+    if (ctx->each_frame_capture == (uintptr_t)cmd->on_completion_priv)
+        ctx->each_frame_capture = 0;
+    ctx->each_frame_pending--;
     mp_wakeup_core(mpctx);
 }
 
@@ -610,14 +661,23 @@ void handle_each_frame_screenshot(struct MPContext *mpctx)
         return;
     ctx->last_frame_count = mpctx->shown_vframes;
 
-    struct mp_waiter wait = MP_WAITER_INITIALIZER;
-    void *a[] = {mpctx, &wait};
-    run_command(mpctx, mp_cmd_clone(ctx->each_frame), NULL, screenshot_fin, a);
-
-    // Block (in a reentrant way) until the screenshot was written. Otherwise,
-    // we could pile up screenshot requests forever.
-    while (!mp_waiter_poll(&wait))
+    uintptr_t seq = ++ctx->each_frame_seq;
+    if (!seq)
+        seq = ++ctx->each_frame_seq;
+    ctx->each_frame_capture = seq;
+    ctx->each_frame_pending++;
+    run_command(mpctx, mp_cmd_clone(ctx->each_frame), NULL, screenshot_fin,
+                (void *)seq);
+
+    // Block (in a reentrant way) until the current frame was grabbed, so that
+    // playback does not move on to the next frame before that.
+    while (ctx->each_frame_capture == seq)
         mp_idle(mpctx);
 
-    mp_waiter_wait(&wait);
+    // Encoding and writing happen on worker threads, but block if too many
+    // screenshots are outstanding. Otherwise, we could pile up screenshot
+    // requests forever.
+    int max = mpctx->opts->screenshot_max_pending;
+    while (ctx->each_frame_pending >= max || ctx->pending_writes >= max)
+        mp_idle(mpctx);
 }
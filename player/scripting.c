@@ -352,12 +352,16 @@ static void init_sym_table(struct mp_script_args *args, void *lib) {
     INIT_SYM(mpv_get_property_osd_string);
     INIT_SYM(mpv_get_property_async);
     INIT_SYM(mpv_observe_property);
+    INIT_SYM(mpv_observe_property_diff);
     INIT_SYM(mpv_unobserve_property);
     INIT_SYM(mpv_event_name);
     INIT_SYM(mpv_event_to_node);
     INIT_SYM(mpv_request_event);
     INIT_SYM(mpv_request_log_messages);
     INIT_SYM(mpv_wait_event);
+    INIT_SYM(mpv_wait_events);
+    INIT_SYM(mpv_set_event_queue_size);
+    INIT_SYM(mpv_get_event_queue_stats);
     INIT_SYM(mpv_wakeup);
     INIT_SYM(mpv_set_wakeup_callback);
     INIT_SYM(mpv_wait_async_requests);
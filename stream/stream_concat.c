@@ -18,6 +18,8 @@
 #include <libavutil/common.h>
 
 #include "common/common.h"
+#include "misc/thread_pool.h"
+#include "osdep/threads.h"
 #include "stream.h"
 
 struct priv {
@@ -27,8 +29,61 @@ struct priv {
     int64_t size;
 
     int cur; // streams[cur] is the stream for current stream.pos
+
+    // Start position of each stream, and the total size at the end (only
+    // valid if the concat stream is seekable).
+    int64_t *base_pos;
+
+    // The next stream is rewound and its buffer filled on a worker thread,
+    // while the current stream is read. This hides open/connect latency at
+    // stream boundaries. The main thread must not touch streams[prefetched]
+    // while prefetch_busy is set.
+    struct mp_thread_pool *tp;
+    mp_mutex lock;
+    mp_cond wakeup;
+    bool prefetch_busy;
+    bool seekable;
+    int prefetched; // index of the prefetched stream, or -1
 };
 
+static void prefetch_fn(void *ctx)
+{
+    struct priv *p = ctx;
+    struct stream *sub = p->streams[p->prefetched];
+
+    if (p->seekable)
+        stream_seek(sub, 0);
+    stream_peek(sub, sub->requested_buffer_size / 2);
+
+    mp_mutex_lock(&p->lock);
+    p->prefetch_busy = false;
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
+static void wait_prefetch(struct priv *p)
+{
+    mp_mutex_lock(&p->lock);
+    while (p->prefetch_busy)
+        mp_cond_wait(&p->wakeup, &p->lock);
+    mp_mutex_unlock(&p->lock);
+}
+
+static void start_prefetch(struct priv *p)
+{
+    int next = p->cur + 1;
+    if (!p->tp || next >= p->num_streams || p->prefetched == next)
+        return;
+
+    wait_prefetch(p);
+    p->prefetched = next;
+    p->prefetch_busy = true;
+    if (!mp_thread_pool_queue(p->tp, prefetch_fn, p)) {
+        p->prefetch_busy = false;
+        p->prefetched = -1;
+    }
+}
+
 static int fill_buffer(struct stream *s, void *buffer, int len)
 {
     struct priv *p = s->priv;
@@ -39,8 +94,13 @@ static int fill_buffer(struct stream *s, void *buffer, int len)
             return res;
 
         p->cur += 1;
-        if (s->seekable)
+        wait_prefetch(p);
+        if (p->prefetched == p->cur) {
+            p->prefetched = -1;
+        } else if (s->seekable) {
             stream_seek(p->streams[p->cur], 0);
+        }
+        start_prefetch(p);
     }
 }
 
@@ -48,28 +108,28 @@ static int seek(struct stream *s, int64_t newpos)
 {
     struct priv *p = s->priv;
 
-    int64_t next_pos = 0;
-    int64_t base_pos = 0;
-
     // Look for the last stream whose start position is <= newpos.
     // Note that the last stream's size is essentially ignored. The last
     // stream is allowed to have an unknown size.
-    for (int n = 0; n < p->num_streams; n++) {
-        if (next_pos > newpos)
-            break;
-
-        base_pos = next_pos;
-        p->cur = n;
-
-        int64_t size = stream_get_size(p->streams[n]);
-        if (size < 0)
-            break;
-
-        next_pos = base_pos + size;
+    int lo = 0, hi = p->num_streams - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (p->base_pos[mid] <= newpos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
     }
+    p->cur = lo;
 
+    wait_prefetch(p);
+    if (p->prefetched == p->cur)
+        p->prefetched = -1;
+
+    int64_t base_pos = p->base_pos[p->cur];
     int ok = stream_seek(p->streams[p->cur], newpos - base_pos);
     s->pos = base_pos + stream_tell(p->streams[p->cur]);
+    start_prefetch(p);
     return ok;
 }
 
@@ -83,6 +143,11 @@ static void s_close(struct stream *s)
 {
     struct priv *p = s->priv;
 
+    // Joins the worker thread, so no prefetch can be running anymore.
+    talloc_free(p->tp);
+    mp_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
+
     for (int n = 0; n < p->num_streams; n++)
         free_stream(p->streams[n]);
 }
@@ -144,8 +209,25 @@ static int open2(struct stream *stream, const struct stream_open_args *args)
         MP_TARRAY_APPEND(p, p->streams, p->num_streams, sub);
     }
 
-    if (stream->seekable)
+    if (stream->seekable) {
         stream->seek = seek;
+        p->base_pos = talloc_array(p, int64_t, p->num_streams + 1);
+        p->base_pos[0] = 0;
+        for (int n = 0; n < p->num_streams; n++) {
+            int64_t size = stream_get_size(p->streams[n]);
+            p->base_pos[n + 1] = p->base_pos[n] + MPMAX(size, 0);
+        }
+    }
+    p->seekable = stream->seekable;
+
+    p->prefetched = -1;
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
+
+    // Threads are created on demand, and exit again when idle.
+    if (p->num_streams > 1)
+        p->tp = mp_thread_pool_create(p, 0, 0, 1);
+    start_prefetch(p);
 
     return STREAM_OK;
 }
@@ -33,10 +33,12 @@
 
 #include "common/common.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "misc/thread_tools.h"
-#include "stream.h"
+#include "options/m_config.h"
 #include "options/m_option.h"
 #include "options/path.h"
+#include "stream.h"
 
 #if HAVE_BSD_FSTATFS
 #include <sys/param.h>
@@ -85,6 +87,35 @@ typedef enum _FSINFOCLASS {
 #endif
 #endif
 
+enum {
+    FADVISE_READAHEAD   = 1 << 0,
+    FADVISE_DROP        = 1 << 1,
+};
+
+struct stream_file_opts {
+    int fadvise;
+    int64_t fadvise_window;
+};
+
+#define OPT_BASE_STRUCT struct stream_file_opts
+
+const struct m_sub_options stream_file_conf = {
+    .opts = (const struct m_option[]){
+        {"stream-fadvise", OPT_CHOICE(fadvise,
+            {"no", 0},
+            {"readahead", FADVISE_READAHEAD},
+            {"drop", FADVISE_DROP},
+            {"yes", FADVISE_READAHEAD | FADVISE_DROP})},
+        {"stream-fadvise-window", OPT_BYTE_SIZE(fadvise_window),
+            M_RANGE(64 * 1024, INT_MAX)},
+        {0}
+    },
+    .size = sizeof(struct stream_file_opts),
+    .defaults = &(const struct stream_file_opts){
+        .fadvise_window = 16 * 1024 * 1024,
+    },
+};
+
 struct priv {
     int fd;
     bool close;
@@ -93,6 +124,15 @@ struct priv {
     bool appending;
     int64_t orig_size;
     struct mp_cancel *cancel;
+
+    // Page cache hints (--stream-fadvise), 0 if disabled.
+    int fadvise;
+    int64_t fadvise_window; // hinted region ahead of and kept behind pos
+    int64_t pos;            // file position after the last read/seek
+    int64_t willneed_end;   // end of the region already hinted as WILLNEED
+    int64_t drop_start;     // start of the read region not yet dropped
+    uint64_t willneed_bytes, dontneed_bytes;
+    struct stats_ctx *stats;
 };
 
 // Total timeout = RETRY_TIMEOUT * MAX_RETRIES
@@ -112,6 +152,37 @@ static int64_t get_size(stream_t *s)
     return -1;
 }
 
+// Tell the kernel which parts of the file will be read soon, and which parts
+// will probably not be read again. Hints are issued in steps of half the
+// window, so that this doesn't cause a syscall on every read.
+static void update_fadvise(stream_t *s)
+{
+#if HAVE_POSIX_FADVISE
+    struct priv *p = s->priv;
+    int64_t step = p->fadvise_window / 2;
+
+    if ((p->fadvise & FADVISE_READAHEAD) && p->willneed_end - p->pos < step) {
+        int64_t start = MPMAX(p->willneed_end, p->pos);
+        int64_t end = p->pos + p->fadvise_window;
+        if (posix_fadvise(p->fd, start, end - start, POSIX_FADV_WILLNEED) == 0) {
+            p->willneed_bytes += end - start;
+            stats_size_value(p->stats, "fadvise-willneed", p->willneed_bytes);
+        }
+        p->willneed_end = end;
+    }
+
+    int64_t drop_end = p->pos - p->fadvise_window;
+    if ((p->fadvise & FADVISE_DROP) && drop_end - p->drop_start >= step) {
+        int64_t len = drop_end - p->drop_start;
+        if (posix_fadvise(p->fd, p->drop_start, len, POSIX_FADV_DONTNEED) == 0) {
+            p->dontneed_bytes += len;
+            stats_size_value(p->stats, "fadvise-dontneed", p->dontneed_bytes);
+        }
+        p->drop_start = drop_end;
+    }
+#endif
+}
+
 static int fill_buffer(stream_t *s, void *buffer, int max_len)
 {
     struct priv *p = s->priv;
@@ -131,8 +202,13 @@ static int fill_buffer(stream_t *s, void *buffer, int max_len)
 
     for (int retries = 0; retries < MAX_RETRIES; retries++) {
         int r = read(p->fd, buffer, max_len);
-        if (r > 0)
+        if (r > 0) {
+            if (p->fadvise) {
+                p->pos += r;
+                update_fadvise(s);
+            }
             return r;
+        }
 
         // Try to detect and handle files being appended during playback.
         int64_t size = get_size(s);
@@ -161,7 +237,19 @@ static int write_buffer(stream_t *s, void *buffer, int len)
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
-    return lseek(p->fd, newpos, SEEK_SET) != (off_t)-1;
+    if (lseek(p->fd, newpos, SEEK_SET) == (off_t)-1)
+        return 0;
+    if (p->fadvise) {
+        // Small forward seeks keep drop_start, so the skipped data is dropped
+        // along with the data read before it. Seeking backwards before it, or
+        // far forward, restarts the dropped region at the new position.
+        if (newpos < p->drop_start || newpos > p->pos + p->fadvise_window)
+            p->drop_start = newpos;
+        p->willneed_end = newpos;
+        p->pos = newpos;
+        update_fadvise(s);
+    }
+    return 1;
 }
 
 static void s_close(stream_t *s)
@@ -396,6 +484,22 @@ static int open_f(stream_t *stream, const struct stream_open_args *args)
 
     p->orig_size = get_size(stream);
 
+#if HAVE_POSIX_FADVISE
+    if (p->regular_file && !write && stream->seekable) {
+        struct stream_file_opts *opts =
+            mp_get_config_group(NULL, stream->global, &stream_file_conf);
+        p->fadvise = opts->fadvise;
+        p->fadvise_window = opts->fadvise_window;
+        talloc_free(opts);
+    }
+    if (p->fadvise) {
+        p->stats = stats_ctx_create(p, stream->global, "stream-file");
+        if (p->fadvise & FADVISE_READAHEAD)
+            posix_fadvise(p->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        update_fadvise(stream);
+    }
+#endif
+
     p->cancel = mp_cancel_new(p);
     if (stream->cancel)
         mp_cancel_set_parent(p->cancel, stream->cancel);
@@ -450,29 +450,131 @@ bool mp_archive_next_entry(struct mp_archive *mpa)
     return success;
 }
 
+// Maximum number of parked archive handles kept around for seeking.
+#define MAX_CHECKPOINTS 4
+
+// libarchive has no way to save and restore decompressor state, so a seek
+// checkpoint is a live archive handle (with its own source stream), which was
+// parked at a known entry offset instead of being destroyed.
+struct checkpoint {
+    struct mp_archive *mpa;
+    struct stream *src;
+    int64_t pos;
+    uint64_t last_use;
+};
+
 struct priv {
     struct mp_archive *mpa;
     bool broken_seek;
     struct stream *src;
+    char *src_url;
     int64_t entry_size;
     char *entry_name;
+    int archive_flags; // 0 if not probed yet
+    int num_volumes;
+    // If >= 0, the entry is stored uncompressed, and is read directly from
+    // src at this byte offset (just like stream_slice.c).
+    int64_t stored_start;
+    struct checkpoint checkpoints[MAX_CHECKPOINTS];
+    int num_checkpoints;
+    uint64_t use_counter;
 };
 
+static void free_checkpoint(struct checkpoint *cp)
+{
+    mp_archive_free(cp->mpa);
+    free_stream(cp->src);
+}
+
+// Move the current archive handle into the checkpoint list (replacing the
+// least recently used one if full). Afterwards, p->mpa and p->src are unset.
+static void park_current(stream_t *s)
+{
+    struct priv *p = s->priv;
+    if (!p->mpa || !p->mpa->arch || !s->pos) {
+        // Not useful as a checkpoint, but p->src can be reused.
+        mp_archive_free(p->mpa);
+        p->mpa = NULL;
+        return;
+    }
+
+    p->num_volumes = p->mpa->num_volumes;
+    if (p->num_checkpoints == MAX_CHECKPOINTS) {
+        int lru = 0;
+        for (int n = 1; n < p->num_checkpoints; n++) {
+            if (p->checkpoints[n].last_use < p->checkpoints[lru].last_use)
+                lru = n;
+        }
+        free_checkpoint(&p->checkpoints[lru]);
+        MP_TARRAY_REMOVE_AT(p->checkpoints, p->num_checkpoints, lru);
+    }
+
+    p->checkpoints[p->num_checkpoints++] = (struct checkpoint){
+        .mpa = p->mpa,
+        .src = p->src,
+        .pos = s->pos,
+        .last_use = ++p->use_counter,
+    };
+    p->mpa = NULL;
+    p->src = NULL;
+}
+
+// Make the handle closest to (but not after) newpos the current one. Returns
+// false if neither the current handle nor any checkpoint can reach newpos by
+// reading forward.
+static bool resume_from_checkpoint(stream_t *s, int64_t newpos)
+{
+    struct priv *p = s->priv;
+    bool current_ok = p->mpa && s->pos <= newpos;
+    int64_t best_pos = current_ok ? s->pos : -1;
+    int best = -1;
+    for (int n = 0; n < p->num_checkpoints; n++) {
+        if (p->checkpoints[n].pos <= newpos && p->checkpoints[n].pos > best_pos) {
+            best = n;
+            best_pos = p->checkpoints[n].pos;
+        }
+    }
+    if (best < 0)
+        return current_ok;
+
+    struct checkpoint cp = p->checkpoints[best];
+    MP_TARRAY_REMOVE_AT(p->checkpoints, p->num_checkpoints, best);
+    park_current(s);
+    free_stream(p->src);
+    p->mpa = cp.mpa;
+    p->src = cp.src;
+    s->pos = cp.pos;
+    MP_VERBOSE(s, "resuming from archive checkpoint at %"PRId64"\n", cp.pos);
+    return true;
+}
+
 static int reopen_archive(stream_t *s)
 {
     struct priv *p = s->priv;
     s->pos = 0;
-    if (!p->mpa) {
+    if (p->mpa) {
+        p->num_volumes = p->mpa->num_volumes;
+        mp_archive_free(p->mpa);
+        p->mpa = NULL;
+    }
+
+    if (!p->src) {
+        p->src = stream_create(p->src_url, STREAM_READ | s->stream_origin,
+                               s->cancel, s->global);
+        if (!p->src)
+            return STREAM_ERROR;
+    }
+
+    if (!p->archive_flags) {
         p->mpa = mp_archive_new(s->log, p->src, MP_ARCHIVE_FLAG_UNSAFE, 0);
     } else {
-        int flags = p->mpa->flags;
-        int num_volumes = p->mpa->num_volumes;
-        mp_archive_free(p->mpa);
-        p->mpa = mp_archive_new_raw(s->log, p->src, flags, num_volumes);
+        p->mpa = mp_archive_new_raw(s->log, p->src, p->archive_flags,
+                                    p->num_volumes);
     }
 
     if (!p->mpa)
         return STREAM_ERROR;
+    p->archive_flags = p->mpa->flags;
 
     // Follows the same logic as demux_libarchive.c.
     struct mp_archive *mpa = p->mpa;
@@ -493,9 +595,109 @@ static int reopen_archive(stream_t *s)
     return STREAM_ERROR;
 }
 
+static uint32_t read_le16(const uint8_t *d)
+{
+    return d[0] | (d[1] << 8);
+}
+
+static uint32_t read_le32(const uint8_t *d)
+{
+    return read_le16(d) | ((uint32_t)read_le16(d + 2) << 16);
+}
+
+// Check whether the current entry is stored uncompressed in a plain zip file.
+// Returns the offset of the entry data in p->src, or -1. The position of
+// p->src is restored, so the archive handle remains usable on failure.
+static int64_t probe_stored_zip_entry(stream_t *s)
+{
+    struct priv *p = s->priv;
+    struct mp_archive *mpa = p->mpa;
+    if (!p->src->seekable || p->entry_size <= 0)
+        return -1;
+
+    locale_t oldlocale = uselocale(mpa->locale);
+    bool ok = (archive_format(mpa->arch) & ARCHIVE_FORMAT_BASE_MASK) ==
+                    ARCHIVE_FORMAT_ZIP &&
+              archive_filter_count(mpa->arch) == 1 &&
+              !archive_entry_is_encrypted(mpa->entry);
+    int64_t hdr_pos = archive_read_header_position(mpa->arch);
+    uselocale(oldlocale);
+    if (!ok || hdr_pos < 0)
+        return -1;
+
+    int64_t old_pos = stream_tell(p->src);
+    int64_t data_pos = -1;
+    uint8_t hdr[30];
+    if (stream_seek(p->src, hdr_pos) &&
+        stream_read(p->src, hdr, sizeof(hdr)) == sizeof(hdr) &&
+        read_le32(hdr) == 0x04034b50)
+    {
+        int zflags = read_le16(hdr + 6);
+        int method = read_le16(hdr + 8);
+        uint32_t csize = read_le32(hdr + 18);
+        bool size_ok = csize == p->entry_size || csize == 0xFFFFFFFF ||
+                       (zflags & 8);
+        if (method == 0 && !(zflags & 1) && size_ok) {
+            data_pos = hdr_pos + sizeof(hdr) + read_le16(hdr + 26) +
+                       read_le16(hdr + 28);
+        }
+    }
+    int64_t src_size = stream_get_size(p->src);
+    if (src_size >= 0 && data_pos + p->entry_size > src_size)
+        data_pos = -1;
+    stream_seek(p->src, old_pos);
+    return data_pos;
+}
+
+// Stored entries don't need libarchive at all for reading. Verify the guessed
+// data offset against what libarchive returns, and switch to direct reading.
+static void try_map_stored_entry(stream_t *s)
+{
+    struct priv *p = s->priv;
+    int64_t data_pos = probe_stored_zip_entry(s);
+    if (data_pos < 0)
+        return;
+
+    char a[4096], b[4096];
+    int len = MPMIN(p->entry_size, sizeof(a));
+    int got = 0;
+    locale_t oldlocale = uselocale(p->mpa->locale);
+    while (got < len) {
+        int r = archive_read_data(p->mpa->arch, a + got, len - got);
+        if (r <= 0)
+            break;
+        got += r;
+    }
+    uselocale(oldlocale);
+
+    bool match = got == len && stream_seek(p->src, data_pos) &&
+                 stream_read(p->src, b, len) == len && memcmp(a, b, len) == 0;
+
+    // The archive handle was advanced; either way it's not usable anymore.
+    mp_archive_free(p->mpa);
+    p->mpa = NULL;
+
+    if (!match || !stream_seek(p->src, data_pos)) {
+        MP_VERBOSE(s, "stored entry data mismatch, using libarchive\n");
+        if (reopen_archive(s) < STREAM_OK)
+            MP_ERR(s, "could not reopen archive\n");
+        return;
+    }
+
+    MP_VERBOSE(s, "entry is stored uncompressed at %"PRId64"\n", data_pos);
+    p->stored_start = data_pos;
+    s->pos = 0;
+}
+
 static int archive_entry_fill_buffer(stream_t *s, void *buffer, int max_len)
 {
     struct priv *p = s->priv;
+    if (p->stored_start >= 0) {
+        int64_t left = p->entry_size - s->pos;
+        if (left <= 0)
+            return 0;
+        return stream_read_partial(p->src, buffer, MPMIN(max_len, left));
+    }
     if (!p->mpa)
         return 0;
     locale_t oldlocale = uselocale(p->mpa->locale);
@@ -514,6 +716,8 @@ static int archive_entry_fill_buffer(stream_t *s, void *buffer, int max_len)
 static int archive_entry_seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
+    if (p->stored_start >= 0)
+        return stream_seek(p->src, p->stored_start + newpos);
     if (p->mpa && !p->broken_seek) {
         locale_t oldlocale = uselocale(p->mpa->locale);
         int r = archive_seek_data(p->mpa->arch, newpos, SEEK_SET);
@@ -525,17 +729,15 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
         if (reopen_archive(s) < STREAM_OK)
             return -1;
     }
-    // libarchive can't seek in most formats.
-    if (newpos < s->pos) {
-        // Hack seeking backwards into working by reopening the archive and
-        // starting over.
+    // libarchive can't seek in most formats. Continue from the closest
+    // checkpoint, or reopen the archive and start over.
+    if (!resume_from_checkpoint(s, newpos)) {
         MP_VERBOSE(s, "trying to reopen archive for performing seek\n");
+        park_current(s);
         if (reopen_archive(s) < STREAM_OK)
             return -1;
     }
     if (newpos > s->pos) {
-        if (!p->mpa && reopen_archive(s) < STREAM_OK)
-            return -1;
         // For seeking forwards, just keep reading data (there's no libarchive
         // skip function either).
         char buffer[4096];
@@ -572,6 +774,9 @@ static int archive_entry_seek(stream_t *s, int64_t newpos)
 static void archive_entry_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    for (int n = 0; n < p->num_checkpoints; n++)
+        free_checkpoint(&p->checkpoints[n]);
+    p->num_checkpoints = 0;
     mp_archive_free(p->mpa);
     free_stream(p->src);
 }
@@ -586,6 +791,7 @@ static int archive_entry_open(stream_t *stream)
 {
     struct priv *p = talloc_zero(stream, struct priv);
     stream->priv = p;
+    p->stored_start = -1;
 
     if (!strchr(stream->path, '|'))
         return STREAM_ERROR;
@@ -599,6 +805,7 @@ static int archive_entry_open(stream_t *stream)
         name += 1;
     p->entry_name = name;
     mp_url_unescape_inplace(base);
+    p->src_url = base;
 
     p->src = stream_create(base, STREAM_READ | stream->stream_origin,
                            stream->cancel, stream->global);
@@ -615,6 +822,11 @@ static int archive_entry_open(stream_t *stream)
 
     stream->fill_buffer = archive_entry_fill_buffer;
     if (p->src->seekable) {
+        try_map_stored_entry(stream);
+        if (p->stored_start < 0 && !p->mpa) {
+            archive_entry_close(stream);
+            return STREAM_ERROR;
+        }
         stream->seek = archive_entry_seek;
         stream->seekable = true;
     }
@@ -21,9 +21,14 @@
 #include <math.h>
 #include <inttypes.h>
 
+#include <libavutil/cpu.h>
+
 #include "common/common.h"
+#include "config.h"
 #include "draw_bmp.h"
 #include "img_convert.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 #include "video/mp_image.h"
 #include "video/repack.h"
 #include "video/sws_utils.h"
@@ -58,6 +63,35 @@ struct slice {
     uint16_t x0, x1;
 };
 
+// Maximum number of threads used for blending.
+#define MAX_BLEND_THREADS 16
+
+// Minimum number of pixels per band for blending on a separate thread. Below
+// this, the thread handoff costs more than it saves.
+#define MIN_BAND_PIXELS (64 * 1024)
+
+// State for blending a horizontal band of the image. Each thread uses its own,
+// because repackers and the temporary slice images can't be shared.
+struct blend_state {
+    struct mp_draw_sub_cache *p;
+
+    struct mp_repack *overlay_to_f32; // convert video_overlay to float
+    struct mp_image *overlay_tmp;   // slice in float32
+
+    struct mp_repack *calpha_to_f32; // convert video_overlay to float
+    struct mp_image *calpha_tmp;    // slice in float32
+
+    struct mp_repack *video_to_f32; // convert video to float
+    struct mp_repack *video_from_f32; // convert float back to video
+    struct mp_image *video_tmp;     // slice in float32
+
+    // Set per blend_overlay_with_video() call.
+    struct mp_image *dst;
+    int y0, y1;                     // rows to blend
+    bool queued;                    // running on a worker thread
+    struct mp_waiter waiter;
+};
+
 struct mp_draw_sub_cache
 {
     struct mpv_global *global;
@@ -86,15 +120,10 @@ struct mp_draw_sub_cache
 
     struct mp_sws_context *sub_scale; // scaler for SUBBITMAP_BGRA
 
-    struct mp_repack *overlay_to_f32; // convert video_overlay to float
-    struct mp_image *overlay_tmp;   // slice in float32
-
-    struct mp_repack *calpha_to_f32; // convert video_overlay to float
-    struct mp_image *calpha_tmp;    // slice in float32
-
-    struct mp_repack *video_to_f32; // convert video to float
-    struct mp_repack *video_from_f32; // convert float back to video
-    struct mp_image *video_tmp;     // slice in float32
+    int rflags;                     // repacker flags for blend_state
+    struct blend_state **states;    // states[0] is used by the calling thread
+    int num_states;
+    struct mp_thread_pool *tp;      // runs states[1..num_states-1]
 
     struct mp_sws_context *premul;  // video -> premultiplied video
     struct mp_sws_context *unpremul; // reverse
@@ -106,13 +135,36 @@ struct mp_draw_sub_cache
     struct mp_image res_overlay;    // returned by mp_draw_sub_overlay()
 };
 
+// __builtin_convertvector() is required by the vector code.
+#if HAVE_VECTOR && defined(__has_builtin)
+#if __has_builtin(__builtin_convertvector)
+#define BLEND_VECTOR 1
+#endif
+#endif
+#ifndef BLEND_VECTOR
+#define BLEND_VECTOR 0
+#endif
+
+#if BLEND_VECTOR
+typedef float v8sf __attribute__ ((vector_size (32), aligned (1)));
+typedef uint8_t v16u8 __attribute__ ((vector_size (16), aligned (1)));
+typedef uint16_t v16u16 __attribute__ ((vector_size (32)));
+#endif
+
 static void blend_line_f32(void *dst, void *src, void *src_a, int w)
 {
     float *dst_f = dst;
     float *src_f = src;
     float *src_a_f = src_a;
 
-    for (int x = 0; x < w; x++)
+    int x = 0;
+#if BLEND_VECTOR
+    for (; x + 8 <= w; x += 8) {
+        v8sf *d = (v8sf *)(dst_f + x);
+        *d = *(v8sf *)(src_f + x) + *d * (1.0f - *(v8sf *)(src_a_f + x));
+    }
+#endif
+    for (; x < w; x++)
         dst_f[x] = src_f[x] + dst_f[x] * (1.0f - src_a_f[x]);
 }
 
@@ -122,15 +174,26 @@ static void blend_line_u8(void *dst, void *src, void *src_a, int w)
     uint8_t *src_i = src;
     uint8_t *src_a_i = src_a;
 
-    for (int x = 0; x < w; x++)
+    int x = 0;
+#if BLEND_VECTOR
+    for (; x + 16 <= w; x += 16) {
+        v16u8 *d = (v16u8 *)(dst_i + x);
+        v16u16 a = __builtin_convertvector(*(v16u8 *)(src_a_i + x), v16u16);
+        v16u16 t = __builtin_convertvector(*d, v16u16) * (255 - a);
+        // Same as t / 255 for t <= 255 * 255.
+        t = (t + 1 + (t >> 8)) >> 8;
+        *d = *(v16u8 *)(src_i + x) + __builtin_convertvector(t, v16u8);
+    }
+#endif
+    for (; x < w; x++)
         dst_i[x] = src_i[x] + dst_i[x] * (255u - src_a_i[x]) / 255u;
 }
 
-static void blend_slice(struct mp_draw_sub_cache *p)
+static void blend_slice(struct mp_draw_sub_cache *p, struct blend_state *st)
 {
-    struct mp_image *ov = p->overlay_tmp;
-    struct mp_image *ca = p->calpha_tmp;
-    struct mp_image *vid = p->video_tmp;
+    struct mp_image *ov = st->overlay_tmp;
+    struct mp_image *ca = st->calpha_tmp;
+    struct mp_image *vid = st->video_tmp;
 
     for (int plane = 0; plane < vid->num_planes; plane++) {
         int xs = vid->fmt.xs[plane];
@@ -147,18 +210,15 @@ static void blend_slice(struct mp_draw_sub_cache *p)
     }
 }
 
-static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
-                                     struct mp_image *dst)
+static void blend_band(struct blend_state *st)
 {
-    if (!repack_config_buffers(p->video_to_f32, 0, p->video_tmp, 0, dst, NULL))
-        return false;
-    if (!repack_config_buffers(p->video_from_f32, 0, dst, 0, p->video_tmp, NULL))
-        return false;
+    struct mp_draw_sub_cache *p = st->p;
+    struct mp_image *dst = st->dst;
 
     int xs = dst->fmt.chroma_xs;
     int ys = dst->fmt.chroma_ys;
 
-    for (int y = 0; y < dst->h; y += p->align_y) {
+    for (int y = st->y0; y < st->y1; y += p->align_y) {
         struct slice *line = &p->slices[y * p->s_w];
 
         for (int sx = 0; sx < p->s_w; sx++) {
@@ -173,14 +233,93 @@ static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
             mp_assert(MP_IS_ALIGNED(w, p->align_x));
             mp_assert(x + w <= p->w);
 
-            repack_line(p->overlay_to_f32, 0, 0, x, y, w);
-            repack_line(p->video_to_f32, 0, 0, x, y, w);
-            if (p->calpha_to_f32)
-                repack_line(p->calpha_to_f32, 0, 0, x >> xs, y >> ys, w >> xs);
+            repack_line(st->overlay_to_f32, 0, 0, x, y, w);
+            repack_line(st->video_to_f32, 0, 0, x, y, w);
+            if (st->calpha_to_f32)
+                repack_line(st->calpha_to_f32, 0, 0, x >> xs, y >> ys, w >> xs);
+
+            blend_slice(p, st);
+
+            repack_line(st->video_from_f32, x, y, 0, 0, w);
+        }
+    }
+}
+
+static void blend_band_thread(void *ptr)
+{
+    struct blend_state *st = ptr;
+
+    blend_band(st);
+    mp_waiter_wakeup(&st->waiter, 0);
+}
+
+static int line_osd_pixels(struct mp_draw_sub_cache *p, int y)
+{
+    struct slice *line = &p->slices[y * p->s_w];
+    int pixels = 0;
+    for (int sx = 0; sx < p->s_w; sx++)
+        pixels += MPMAX(line[sx].x1 - line[sx].x0, 0);
+    return pixels;
+}
+
+// Split the image rows into bands with roughly the same number of OSD pixels,
+// and assign them to the blend states. Returns the number of bands.
+static int split_bands(struct mp_draw_sub_cache *p, int h)
+{
+    int64_t total = 0;
+    for (int y = 0; y < h; y += p->align_y)
+        total += line_osd_pixels(p, y);
+
+    int num = MPCLAMP(total / MIN_BAND_PIXELS, 1, p->num_states);
+
+    int n = 0;
+    int64_t done = 0;
+    p->states[0]->y0 = 0;
+    for (int y = 0; y < h; y += p->align_y) {
+        done += line_osd_pixels(p, y);
+        if (n + 1 < num && done * num >= total * (n + 1)) {
+            p->states[n]->y1 = y + p->align_y;
+            n++;
+            p->states[n]->y0 = y + p->align_y;
+        }
+    }
+    p->states[n]->y1 = h;
+
+    return n + 1;
+}
+
+static bool blend_overlay_with_video(struct mp_draw_sub_cache *p,
+                                     struct mp_image *dst)
+{
+    for (int n = 0; n < p->num_states; n++) {
+        struct blend_state *st = p->states[n];
+
+        if (!repack_config_buffers(st->video_to_f32, 0, st->video_tmp, 0, dst, NULL))
+            return false;
+        if (!repack_config_buffers(st->video_from_f32, 0, dst, 0, st->video_tmp, NULL))
+            return false;
+        st->dst = dst;
+    }
+
+    int num_bands = split_bands(p, dst->h);
 
-            blend_slice(p);
+    for (int n = 1; n < num_bands; n++) {
+        struct blend_state *st = p->states[n];
 
-            repack_line(p->video_from_f32, x, y, 0, 0, w);
+        st->waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+        st->queued = mp_thread_pool_run(p->tp, blend_band_thread, st);
+    }
+
+    blend_band(p->states[0]);
+
+    // If a thread could not be started, blend its band here.
+    for (int n = 1; n < num_bands; n++) {
+        struct blend_state *st = p->states[n];
+
+        if (st->queued) {
+            mp_waiter_wait(&st->waiter);
+        } else {
+            blend_band(st);
         }
     }
 
@@ -520,11 +659,92 @@ static void init_general(struct mp_draw_sub_cache *p)
     clear_rgba_overlay(p);
 }
 
+// Setup st like ref (which must have been fully initialized).
+static bool init_blend_state(struct mp_draw_sub_cache *p, struct blend_state *st,
+                             struct blend_state *ref)
+{
+    int imgfmt = p->params.imgfmt;
+
+    st->p = p;
+
+    st->video_to_f32 = mp_repack_create_planar(imgfmt, false, p->rflags);
+    talloc_steal(st, st->video_to_f32);
+    st->video_from_f32 = mp_repack_create_planar(imgfmt, true, p->rflags);
+    talloc_steal(st, st->video_from_f32);
+    st->overlay_to_f32 = mp_repack_create_planar(
+        mp_repack_get_format_src(ref->overlay_to_f32), false, p->rflags);
+    talloc_steal(st, st->overlay_to_f32);
+    if (!st->video_to_f32 || !st->video_from_f32 || !st->overlay_to_f32)
+        return false;
+
+    st->overlay_tmp = talloc_steal(st, mp_image_alloc(ref->overlay_tmp->imgfmt,
+                                                      SLICE_W, p->align_y));
+    st->video_tmp = talloc_steal(st, mp_image_alloc(ref->video_tmp->imgfmt,
+                                                    SLICE_W, p->align_y));
+    if (!st->overlay_tmp || !st->video_tmp)
+        return false;
+
+    st->overlay_tmp->params.repr = ref->overlay_tmp->params.repr;
+    st->overlay_tmp->params.color = ref->overlay_tmp->params.color;
+    st->video_tmp->params.repr = ref->video_tmp->params.repr;
+    st->video_tmp->params.color = ref->video_tmp->params.color;
+
+    struct mp_image *overlay = p->video_overlay ? p->video_overlay : p->rgba_overlay;
+    if (!repack_config_buffers(st->overlay_to_f32, 0, st->overlay_tmp,
+                               0, overlay, NULL))
+        return false;
+
+    if (ref->calpha_to_f32) {
+        st->calpha_to_f32 = mp_repack_create_planar(
+            mp_repack_get_format_src(ref->calpha_to_f32), false, p->rflags);
+        talloc_steal(st, st->calpha_to_f32);
+        if (!st->calpha_to_f32)
+            return false;
+
+        st->calpha_tmp = talloc_steal(st, mp_image_alloc(ref->calpha_tmp->imgfmt,
+                                                         SLICE_W, 1));
+        if (!st->calpha_tmp)
+            return false;
+
+        if (!repack_config_buffers(st->calpha_to_f32, 0, st->calpha_tmp,
+                                   0, p->calpha_overlay, NULL))
+            return false;
+    }
+
+    return true;
+}
+
+// Create the additional blend states and the threads that use them. Threads
+// are only started on demand, i.e. when there is enough OSD to blend, and
+// exit again when no OSD has been blended for a while.
+static bool init_blend_threads(struct mp_draw_sub_cache *p)
+{
+    int threads = MPCLAMP(av_cpu_count(), 1, MAX_BLEND_THREADS) - 1;
+    if (!threads)
+        return true;
+
+    // (Can't fail with init_threads=0.)
+    p->tp = mp_thread_pool_create(p, 0, 0, threads);
+
+    for (int n = 0; n < threads; n++) {
+        struct blend_state *st = talloc_zero(p, struct blend_state);
+        MP_TARRAY_APPEND(p, p->states, p->num_states, st);
+        if (!init_blend_state(p, st, p->states[0]))
+            return false;
+    }
+
+    return true;
+}
+
 static bool reinit_to_video(struct mp_draw_sub_cache *p)
 {
     struct mp_image_params *params = &p->params;
     mp_image_params_guess_csp(params);
 
+    struct blend_state *st = talloc_zero(p, struct blend_state);
+    st->p = p;
+    MP_TARRAY_APPEND(p, p->states, p->num_states, st);
+
     bool need_premul = params->repr.alpha != PL_ALPHA_PREMULTIPLIED &&
         (mp_imgfmt_get_desc(params->imgfmt).flags & MP_IMGFLAG_ALPHA);
 
@@ -539,11 +759,11 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
     int rflags = REPACK_CREATE_EXPAND_8BIT;
     bool use_shortcut = false;
 
-    p->video_to_f32 = mp_repack_create_planar(params->imgfmt, false, rflags);
-    talloc_steal(p, p->video_to_f32);
-    if (!p->video_to_f32)
+    st->video_to_f32 = mp_repack_create_planar(params->imgfmt, false, rflags);
+    talloc_steal(st, st->video_to_f32);
+    if (!st->video_to_f32)
         return false;
-    mp_get_regular_imgfmt(&vfdesc, mp_repack_get_format_dst(p->video_to_f32));
+    mp_get_regular_imgfmt(&vfdesc, mp_repack_get_format_dst(st->video_to_f32));
     mp_assert(vfdesc.num_planes); // must have succeeded
 
     if (params->repr.sys == PL_COLOR_SYSTEM_RGB && vfdesc.num_planes >= 3) {
@@ -556,16 +776,16 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
 
     // If no special blender is available, blend in float.
     if (!p->blend_line) {
-        TA_FREEP(&p->video_to_f32);
+        TA_FREEP(&st->video_to_f32);
 
         rflags |= REPACK_CREATE_PLANAR_F32;
 
-        p->video_to_f32 = mp_repack_create_planar(params->imgfmt, false, rflags);
-        talloc_steal(p, p->video_to_f32);
-        if (!p->video_to_f32)
+        st->video_to_f32 = mp_repack_create_planar(params->imgfmt, false, rflags);
+        talloc_steal(st, st->video_to_f32);
+        if (!st->video_to_f32)
             return false;
 
-        mp_get_regular_imgfmt(&vfdesc, mp_repack_get_format_dst(p->video_to_f32));
+        mp_get_regular_imgfmt(&vfdesc, mp_repack_get_format_dst(st->video_to_f32));
         mp_assert(vfdesc.component_type == MP_COMPONENT_TYPE_FLOAT);
 
         p->blend_line = blend_line_f32;
@@ -573,15 +793,15 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
 
     p->scale_in_tiles = SCALE_IN_TILES;
 
-    int vid_f32_fmt = mp_repack_get_format_dst(p->video_to_f32);
+    int vid_f32_fmt = mp_repack_get_format_dst(st->video_to_f32);
 
-    p->video_from_f32 = mp_repack_create_planar(params->imgfmt, true, rflags);
-    talloc_steal(p, p->video_from_f32);
-    if (!p->video_from_f32)
+    st->video_from_f32 = mp_repack_create_planar(params->imgfmt, true, rflags);
+    talloc_steal(st, st->video_from_f32);
+    if (!st->video_from_f32)
         return false;
 
-    mp_assert(mp_repack_get_format_dst(p->video_to_f32) ==
-           mp_repack_get_format_src(p->video_from_f32));
+    mp_assert(mp_repack_get_format_dst(st->video_to_f32) ==
+           mp_repack_get_format_src(st->video_from_f32));
 
     int overlay_fmt = 0;
     if (use_shortcut) {
@@ -609,12 +829,12 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
     if (!overlay_fmt)
         return false;
 
-    p->overlay_to_f32 = mp_repack_create_planar(overlay_fmt, false, rflags);
-    talloc_steal(p, p->overlay_to_f32);
-    if (!p->overlay_to_f32)
+    st->overlay_to_f32 = mp_repack_create_planar(overlay_fmt, false, rflags);
+    talloc_steal(st, st->overlay_to_f32);
+    if (!st->overlay_to_f32)
         return false;
 
-    int render_fmt = mp_repack_get_format_dst(p->overlay_to_f32);
+    int render_fmt = mp_repack_get_format_dst(st->overlay_to_f32);
 
     struct mp_regular_imgfmt ofdesc = {0};
     mp_get_regular_imgfmt(&ofdesc, render_fmt);
@@ -631,11 +851,11 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
             return false;
     }
 
-    p->align_x = mp_repack_get_align_x(p->video_to_f32);
-    p->align_y = mp_repack_get_align_y(p->video_to_f32);
+    p->align_x = mp_repack_get_align_x(st->video_to_f32);
+    p->align_y = mp_repack_get_align_y(st->video_to_f32);
 
-    mp_assert(p->align_x >= mp_repack_get_align_x(p->overlay_to_f32));
-    mp_assert(p->align_y >= mp_repack_get_align_y(p->overlay_to_f32));
+    mp_assert(p->align_x >= mp_repack_get_align_x(st->overlay_to_f32));
+    mp_assert(p->align_y >= mp_repack_get_align_y(st->overlay_to_f32));
 
     if (p->align_x > SLICE_W || p->align_y > TILE_H)
         return false;
@@ -654,21 +874,21 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
     }
 
     p->rgba_overlay = talloc_steal(p, mp_image_alloc(IMGFMT_BGRA, w, h));
-    p->overlay_tmp = talloc_steal(p, mp_image_alloc(render_fmt, SLICE_W, slice_h));
-    p->video_tmp = talloc_steal(p, mp_image_alloc(vid_f32_fmt, SLICE_W, slice_h));
-    if (!p->rgba_overlay || !p->overlay_tmp || !p->video_tmp)
+    st->overlay_tmp = talloc_steal(st, mp_image_alloc(render_fmt, SLICE_W, slice_h));
+    st->video_tmp = talloc_steal(st, mp_image_alloc(vid_f32_fmt, SLICE_W, slice_h));
+    if (!p->rgba_overlay || !st->overlay_tmp || !st->video_tmp)
         return false;
 
     mp_image_params_guess_csp(&p->rgba_overlay->params);
     p->rgba_overlay->params.repr.alpha = PL_ALPHA_PREMULTIPLIED;
 
-    p->overlay_tmp->params.repr = params->repr;
-    p->overlay_tmp->params.color = params->color;
-    p->video_tmp->params.repr = params->repr;
-    p->video_tmp->params.color = params->color;
+    st->overlay_tmp->params.repr = params->repr;
+    st->overlay_tmp->params.color = params->color;
+    st->video_tmp->params.repr = params->repr;
+    st->video_tmp->params.color = params->color;
 
     if (p->rgba_overlay->imgfmt == overlay_fmt) {
-        if (!repack_config_buffers(p->overlay_to_f32, 0, p->overlay_tmp,
+        if (!repack_config_buffers(st->overlay_to_f32, 0, st->overlay_tmp,
                                    0, p->rgba_overlay, NULL))
             return false;
     } else {
@@ -691,7 +911,7 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
                             p->video_overlay->imgfmt, p->rgba_overlay->imgfmt))
             return false;
 
-        if (!repack_config_buffers(p->overlay_to_f32, 0, p->overlay_tmp,
+        if (!repack_config_buffers(st->overlay_to_f32, 0, st->overlay_tmp,
                                    0, p->video_overlay, NULL))
             return false;
 
@@ -737,17 +957,17 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
             p->calpha_overlay->params.repr = p->alpha_overlay->params.repr;
             p->calpha_overlay->params.color = p->alpha_overlay->params.color;
 
-            p->calpha_to_f32 = mp_repack_create_planar(calpha_fmt, false, rflags);
-            talloc_steal(p, p->calpha_to_f32);
-            if (!p->calpha_to_f32)
+            st->calpha_to_f32 = mp_repack_create_planar(calpha_fmt, false, rflags);
+            talloc_steal(st, st->calpha_to_f32);
+            if (!st->calpha_to_f32)
                 return false;
 
-            int af32_fmt = mp_repack_get_format_dst(p->calpha_to_f32);
-            p->calpha_tmp = talloc_steal(p, mp_image_alloc(af32_fmt, SLICE_W, 1));
-            if (!p->calpha_tmp)
+            int af32_fmt = mp_repack_get_format_dst(st->calpha_to_f32);
+            st->calpha_tmp = talloc_steal(st, mp_image_alloc(af32_fmt, SLICE_W, 1));
+            if (!st->calpha_tmp)
                 return false;
 
-            if (!repack_config_buffers(p->calpha_to_f32, 0, p->calpha_tmp,
+            if (!repack_config_buffers(st->calpha_to_f32, 0, st->calpha_tmp,
                                        0, p->calpha_overlay, NULL))
                 return false;
 
@@ -773,6 +993,10 @@ static bool reinit_to_video(struct mp_draw_sub_cache *p)
         p->unpremul->force_scaler = MP_SWS_ZIMG;
     }
 
+    p->rflags = rflags;
+    if (!init_blend_threads(p))
+        return false;
+
     init_general(p);
 
     return true;
@@ -834,11 +1058,12 @@ char *mp_draw_sub_get_dbg_info(struct mp_draw_sub_cache *p)
         "align=%d:%d ov=%-7s, ov_f=%s, v_f=%s, a=%s, ca=%s, ca_f=%s",
         p->align_x, p->align_y,
         mp_imgfmt_to_name(p->video_overlay ? p->video_overlay->imgfmt : 0),
-        mp_imgfmt_to_name(p->overlay_tmp->imgfmt),
-        mp_imgfmt_to_name(p->video_tmp->imgfmt),
+        mp_imgfmt_to_name(p->states[0]->overlay_tmp->imgfmt),
+        mp_imgfmt_to_name(p->states[0]->video_tmp->imgfmt),
         mp_imgfmt_to_name(p->alpha_overlay ? p->alpha_overlay->imgfmt : 0),
         mp_imgfmt_to_name(p->calpha_overlay ? p->calpha_overlay->imgfmt : 0),
-        mp_imgfmt_to_name(p->calpha_tmp ? p->calpha_tmp->imgfmt : 0));
+        mp_imgfmt_to_name(p->states[0]->calpha_tmp ?
+                          p->states[0]->calpha_tmp->imgfmt : 0));
 }
 
 struct mp_draw_sub_cache *mp_draw_sub_alloc(void *ta_parent, struct mpv_global *g)
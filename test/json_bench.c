@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <mpv/client.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+#include "misc/json.h"
+#include "misc/node.h"
+#include "osdep/timer.h"
+#include "test_utils.h"
+
+// Roughly what a client sees when observing track-list or playlist: an array
+// of flat maps with strings, numbers and flags.
+static char *make_input(void *ta_parent, int num_entries)
+{
+    bstr s = {0};
+    bstr_xappend(ta_parent, &s, bstr0("["));
+    for (int n = 0; n < num_entries; n++) {
+        bstr_xappend_asprintf(ta_parent, &s,
+            "%s{\"id\":%d,\"type\":\"audio\",\"src-id\":%d,"
+            "\"title\":\"Track \\\"%d\\\" (commentary)\",\"lang\":\"eng\","
+            "\"default\":%s,\"forced\":false,\"external\":false,"
+            "\"filename\":\"/media/some directory/file name %d.mkv\","
+            "\"demux-samplerate\":48000,\"demux-bitrate\":%d.5,"
+            "\"codec\":\"opus\",\"ff-index\":%d,\"selected\":%s}",
+            n ? "," : "", n, n + 1, n, n % 3 ? "false" : "true", n,
+            128000 + n, n, n == 1 ? "true" : "false");
+    }
+    bstr_xappend(ta_parent, &s, bstr0("]"));
+    return s.start;
+}
+
+int main(int argc, char *argv[])
+{
+    mp_time_init();
+
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    void *tmp = talloc_new(NULL);
+    char *input = make_input(tmp, 1000);
+    size_t input_len = strlen(input);
+
+    // Parse
+    struct mpv_node res;
+    int64_t start = mp_time_ns();
+    for (int n = 0; n < iterations; n++) {
+        void *ctx = talloc_new(NULL);
+        char *s = talloc_strdup(ctx, input);
+        assert_true(json_parse(ctx, &res, &s, MAX_JSON_DEPTH) >= 0);
+        talloc_free(ctx);
+    }
+    double parse_time = MP_TIME_NS_TO_S(mp_time_ns() - start);
+
+    // Write
+    char *s = talloc_strdup(tmp, input);
+    assert_true(json_parse(tmp, &res, &s, MAX_JSON_DEPTH) >= 0);
+    start = mp_time_ns();
+    for (int n = 0; n < iterations; n++) {
+        char *out = talloc_strdup(NULL, "");
+        assert_true(json_write(&out, &res) >= 0);
+        talloc_free(out);
+    }
+    double write_time = MP_TIME_NS_TO_S(mp_time_ns() - start);
+
+    double mb = input_len * (double)iterations / (1024 * 1024);
+    printf("input: %zu bytes, %d iterations\n", input_len, iterations);
+    printf("parse: %.1f MiB/s\n", mb / parse_time);
+    printf("write: %.1f MiB/s\n", mb / write_time);
+
+    talloc_free(tmp);
+    return 0;
+}
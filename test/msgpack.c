@@ -0,0 +1,95 @@
+#include <mpv/client.h>
+
+#include "misc/bstr.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "test_utils.h"
+
+struct entry {
+    const char *bytes;
+    int len;
+    struct mpv_node data;
+};
+
+#define B(s) s, sizeof(s) - 1
+
+#define VAL_LIST(...) (struct mpv_node[]){__VA_ARGS__}
+
+#define L(...) __VA_ARGS__
+
+#define NODE_INT64(v) {.format = MPV_FORMAT_INT64,  .u = { .int64 = (v) }}
+#define NODE_STR(v)   {.format = MPV_FORMAT_STRING, .u = { .string = (v) }}
+#define NODE_BOOL(v)  {.format = MPV_FORMAT_FLAG,   .u = { .flag = (bool)(v) }}
+#define NODE_FLOAT(v) {.format = MPV_FORMAT_DOUBLE, .u = { .double_ = (v) }}
+#define NODE_NONE()   {.format = MPV_FORMAT_NONE }
+#define NODE_ARRAY(...) {.format = MPV_FORMAT_NODE_ARRAY, .u = { .list =    \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(__VA_ARGS__)) / sizeof(struct mpv_node),     \
+        .values = VAL_LIST(__VA_ARGS__)}}}
+#define NODE_MAP(k, v) {.format = MPV_FORMAT_NODE_MAP, .u = { .list =       \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(v)) / sizeof(struct mpv_node),               \
+        .values = VAL_LIST(v),                                              \
+        .keys = (char**)(const char *[]){k}}}}
+
+static const struct entry entries[] = {
+    { B("\xc0"), NODE_NONE()},
+    { B("\xc3"), NODE_BOOL(true)},
+    { B("\xc2"), NODE_BOOL(false)},
+    { B("\x00"), NODE_INT64(0)},
+    { B("\x7f"), NODE_INT64(127)},
+    { B("\xff"), NODE_INT64(-1)},
+    { B("\xcc\x80"), NODE_INT64(128)},
+    { B("\xd0\xdf"), NODE_INT64(-33)},
+    { B("\xcd\x01\x00"), NODE_INT64(256)},
+    { B("\xd3\x80\x00\x00\x00\x00\x00\x00\x00"), NODE_INT64(INT64_MIN)},
+    { B("\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00"), NODE_FLOAT(1.5)},
+    { B("\xa3" "abc"), NODE_STR("abc")},
+    { B("\x92\x01\xa1" "a"), NODE_ARRAY(NODE_INT64(1), NODE_STR("a"))},
+    { B("\x82\xa1" "a\x01\xa1" "b\x91\xc0"),
+        NODE_MAP(L("a", "b"), L(NODE_INT64(1), NODE_ARRAY(NODE_NONE())))},
+};
+
+int main(void)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
+        const struct entry *e = &entries[n];
+        void *tmp = talloc_new(NULL);
+        bstr src = {(unsigned char *)e->bytes, e->len};
+        struct mpv_node res;
+        assert_true(msgpack_parse(tmp, &res, &src, MAX_MSGPACK_DEPTH) >= 0);
+        assert_int_equal(src.len, 0);
+        assert_true(equal_mpv_node(&e->data, &res));
+        bstr out = {0};
+        assert_true(msgpack_append(&out, &res) >= 0);
+        assert_int_equal(out.len, e->len);
+        assert_memcmp(out.start, e->bytes, e->len);
+        talloc_free(out.start);
+        talloc_free(tmp);
+    }
+
+    // Frames: must wait for the complete payload.
+    void *tmp = talloc_new(NULL);
+    struct mpv_node node = NODE_ARRAY(NODE_INT64(1), NODE_STR("x"));
+    bstr frame = {0};
+    assert_true(msgpack_append_frame(&frame, &node) >= 0);
+    assert_int_equal(frame.len, MSGPACK_FRAME_HEADER + 4);
+    bstr part = bstr_splice(frame, 0, frame.len - 1);
+    assert_true(msgpack_frame_size(part) < 0);
+    assert_int_equal(msgpack_frame_size(frame), frame.len);
+    struct mpv_node res;
+    bstr src = frame;
+    assert_true(msgpack_parse_frame(tmp, &res, &src, MAX_MSGPACK_DEPTH) >= 0);
+    assert_int_equal(src.len, 0);
+    assert_true(equal_mpv_node(&node, &res));
+
+    // Truncated input and excessive nesting are rejected.
+    src = (bstr){(unsigned char *)"\x92\x01", 2};
+    assert_true(msgpack_parse(tmp, &res, &src, MAX_MSGPACK_DEPTH) < 0);
+    src = (bstr){(unsigned char *)"\x91\x91\x91\x90", 4};
+    assert_true(msgpack_parse(tmp, &res, &src, 2) < 0);
+
+    talloc_free(frame.start);
+    talloc_free(tmp);
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include <mpv/client.h>
+
+#include "misc/node.h"
+#include "misc/random.h"
+#include "test_utils.h"
+
+// Build an array of maps with the given ids. The "v" field is used to check
+// "change" operations.
+static struct mpv_node *make_list(void *ta_parent, const int *ids, int num,
+                                  int v)
+{
+    struct mpv_node *list = talloc(ta_parent, struct mpv_node);
+    node_init(list, MPV_FORMAT_NODE_ARRAY, NULL);
+    talloc_steal(list, list->u.list);
+    for (int n = 0; n < num; n++) {
+        struct mpv_node *e = node_array_add(list, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", ids[n]);
+        node_map_add_int64(e, "v", v);
+    }
+    return list;
+}
+
+#define LIST(tmp, v, ...) \
+    make_list(tmp, (const int[]){__VA_ARGS__}, \
+              sizeof((const int[]){__VA_ARGS__}) / sizeof(int), v)
+#define EMPTY(tmp) make_list(tmp, NULL, 0, 0)
+
+static int64_t get_int(struct mpv_node *map, const char *key)
+{
+    struct mpv_node *n = node_map_get(map, key);
+    mp_require(n && n->format == MPV_FORMAT_INT64);
+    return n->u.int64;
+}
+
+// Apply the operations returned by node_array_diff() to a copy of old, and
+// check that the result is equal to new. Returns the number of operations.
+static int check_diff(struct mpv_node *old, struct mpv_node *new)
+{
+    void *tmp = talloc_new(NULL);
+    struct mpv_node ops;
+    node_init(&ops, MPV_FORMAT_NODE_ARRAY, NULL);
+    talloc_steal(tmp, ops.u.list);
+    assert_true(node_array_diff(&ops, old, new));
+
+    struct mpv_node *items = NULL;
+    int num_items = 0;
+    for (int n = 0; n < old->u.list->num; n++)
+        MP_TARRAY_APPEND(tmp, items, num_items, old->u.list->values[n]);
+
+    for (int n = 0; n < ops.u.list->num; n++) {
+        struct mpv_node *op = &ops.u.list->values[n];
+        assert_int_equal(op->format, MPV_FORMAT_NODE_MAP);
+        const char *name = node_map_get(op, "op")->u.string;
+        int index = get_int(op, "index");
+        struct mpv_node *value = node_map_get(op, "value");
+        if (strcmp(name, "remove") == 0) {
+            assert_true(index >= 0 && index < num_items);
+            MP_TARRAY_REMOVE_AT(items, num_items, index);
+        } else if (strcmp(name, "insert") == 0) {
+            assert_true(index >= 0 && index <= num_items);
+            assert_true(value);
+            MP_TARRAY_INSERT_AT(tmp, items, num_items, index, *value);
+        } else if (strcmp(name, "move") == 0) {
+            int from = get_int(op, "from");
+            assert_true(from >= 0 && from < num_items);
+            struct mpv_node item = items[from];
+            MP_TARRAY_REMOVE_AT(items, num_items, from);
+            assert_true(index >= 0 && index <= num_items);
+            MP_TARRAY_INSERT_AT(tmp, items, num_items, index, item);
+        } else if (strcmp(name, "change") == 0) {
+            assert_true(index >= 0 && index < num_items);
+            assert_true(value);
+            items[index] = *value;
+        } else {
+            mp_require(false);
+        }
+    }
+
+    struct mpv_node res = {
+        .format = MPV_FORMAT_NODE_ARRAY,
+        .u.list = &(struct mpv_node_list){ .num = num_items, .values = items },
+    };
+    assert_true(equal_mpv_node(&res, new));
+
+    int num_ops = ops.u.list->num;
+    talloc_free(tmp);
+    return num_ops;
+}
+
+static void test_fail(struct mpv_node *old, struct mpv_node *new)
+{
+    struct mpv_node ops;
+    node_init(&ops, MPV_FORMAT_NODE_ARRAY, NULL);
+    assert_false(node_array_diff(&ops, old, new));
+    talloc_free(ops.u.list);
+}
+
+int main(void)
+{
+    void *tmp = talloc_new(NULL);
+
+    // Empty lists.
+    assert_int_equal(check_diff(EMPTY(tmp), EMPTY(tmp)), 0);
+    assert_int_equal(check_diff(EMPTY(tmp), LIST(tmp, 0, 1, 2, 3)), 3);
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3), EMPTY(tmp)), 3);
+
+    // Unchanged, and changed values only.
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3),
+                                LIST(tmp, 0, 1, 2, 3)), 0);
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3),
+                                LIST(tmp, 1, 1, 2, 3)), 3);
+
+    // Moving a single entry is a single move, in both directions.
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3, 4, 5),
+                                LIST(tmp, 0, 1, 4, 2, 3, 5)), 1);
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3, 4, 5),
+                                LIST(tmp, 0, 1, 3, 4, 2, 5)), 1);
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3, 4, 5),
+                                LIST(tmp, 0, 5, 1, 2, 3, 4)), 1);
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3, 4, 5),
+                                LIST(tmp, 0, 2, 3, 4, 5, 1)), 1);
+
+    // Removals, inserts and moves combined.
+    check_diff(LIST(tmp, 0, 6, 5, 4, 3, 2, 1), LIST(tmp, 0, 1, 2, 3, 4, 5, 6));
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 2, 3, 4),
+                                LIST(tmp, 0, 1, 3)), 2);
+    assert_int_equal(check_diff(LIST(tmp, 0, 1, 3),
+                                LIST(tmp, 0, 0, 1, 2, 3, 4)), 3);
+    check_diff(LIST(tmp, 0, 1, 2, 3, 4, 5), LIST(tmp, 0, 7, 5, 2, 8, 1));
+    check_diff(LIST(tmp, 0, 1, 2, 3), LIST(tmp, 0, 4, 5, 6));
+
+    // Entries are identified by "id" plus "type".
+    struct mpv_node *tracks = EMPTY(tmp);
+    const char *types[] = {"video", "audio", "sub"};
+    for (int n = 0; n < 6; n++) {
+        struct mpv_node *e = node_array_add(tracks, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", n / 3 + 1);
+        node_map_add_string(e, "type", types[n % 3]);
+    }
+    struct mpv_node *tracks2 = EMPTY(tmp);
+    for (int n = 5; n >= 0; n--)
+        *node_array_add(tracks2, MPV_FORMAT_NONE) = tracks->u.list->values[n];
+    check_diff(tracks, tracks2);
+
+    // Duplicate ids in either list.
+    test_fail(LIST(tmp, 0, 1, 2, 1), LIST(tmp, 0, 1, 2));
+    test_fail(LIST(tmp, 0, 1, 2), LIST(tmp, 0, 2, 2));
+
+    // Entries without an integer id.
+    struct mpv_node *bad = LIST(tmp, 0, 1, 2);
+    struct mpv_node *e = node_array_add(bad, MPV_FORMAT_NODE_MAP);
+    node_map_add_int64(e, "v", 0);
+    test_fail(LIST(tmp, 0, 1, 2), bad);
+    test_fail(bad, LIST(tmp, 0, 1, 2));
+    bad = LIST(tmp, 0, 1, 2);
+    e = node_array_add(bad, MPV_FORMAT_NODE_MAP);
+    node_map_add_string(e, "id", "3");
+    test_fail(bad, EMPTY(tmp));
+
+    // Random permutations, with some entries removed, added and changed.
+    mp_rand_state s = mp_rand_seed(1);
+    for (int run = 0; run < 1000; run++) {
+        int num_old = mp_rand_in_range32(&s, 0, 40);
+        int num_new = mp_rand_in_range32(&s, 0, 40);
+        int ids[80];
+        for (int n = 0; n < 80; n++)
+            ids[n] = n;
+        for (int n = 79; n > 0; n--) {
+            int k = mp_rand_in_range32(&s, 0, n + 1);
+            MPSWAP(int, ids[n], ids[k]);
+        }
+        struct mpv_node *old = make_list(tmp, ids, num_old, 0);
+        // Mostly the same ids, reordered.
+        for (int n = 0; n < num_new; n++) {
+            int k = mp_rand_in_range32(&s, n, 80);
+            if (mp_rand_in_range32(&s, 0, 4) && n < num_old && k >= num_old)
+                k = mp_rand_in_range32(&s, n, num_old);
+            MPSWAP(int, ids[n], ids[k]);
+        }
+        struct mpv_node *new = make_list(tmp, ids, num_new, 0);
+        for (int n = 0; n < num_new; n++) {
+            if (!mp_rand_in_range32(&s, 0, 8))
+                node_map_get(&new->u.list->values[n], "v")->u.int64 = 1;
+        }
+        check_diff(old, new);
+    }
+
+    talloc_free(tmp);
+    return 0;
+}
@@ -434,6 +434,82 @@ static void check_float_repack(int imgfmt, enum pl_color_system csp,
     talloc_free(from_f);
 }
 
+// Compare repacking a long line against repacking it pixel by pixel. The
+// latter always goes through the scalar code, while the former uses the
+// vector code (if available) with a scalar tail, so this checks that both are
+// bit-exact.
+static void check_wide_repack(int imgfmt, int flags)
+{
+    imgfmt = UNFUCK(imgfmt);
+
+    static const int widths[] = {1, 7, 8, 15, 16, 17, 31, 33, 100, 1923};
+    int max_w = widths[MP_ARRAY_SIZE(widths) - 1];
+
+    for (int pack = 0; pack < 2; pack++) {
+        struct mp_repack *rp = mp_repack_create_planar(imgfmt, pack, flags);
+        mp_require(rp);
+
+        int ax = mp_repack_get_align_x(rp);
+        int ay = mp_repack_get_align_y(rp);
+        int fmt_src = mp_repack_get_format_src(rp);
+        int fmt_dst = mp_repack_get_format_dst(rp);
+        int img_w = (max_w + 2) * ax;
+
+        struct mp_image *src = mp_image_alloc(fmt_src, img_w, ay);
+        struct mp_image *ref = mp_image_alloc(fmt_dst, img_w, ay);
+        struct mp_image *out = mp_image_alloc(fmt_dst, img_w, ay);
+        mp_require(src && ref && out);
+
+        bool is_float =
+            mp_imgfmt_get_component_type(fmt_src) == MP_COMPONENT_TYPE_FLOAT;
+        srand(1);
+        for (int p = 0; p < src->num_planes; p++) {
+            for (int y = 0; y < mp_image_plane_h(src, p); y++) {
+                uint8_t *line = src->planes[p] + src->stride[p] * y;
+                int bytes = mp_image_plane_bytes(src, p, 0, img_w);
+                for (int x = 0; x < bytes; x++)
+                    line[x] = rand();
+                // Keep floats in a sane range; lrint() is not well defined
+                // for values that don't fit.
+                for (int x = 0; is_float && x < bytes / 4; x++)
+                    ((float *)line)[x] = (rand() % 1500 - 250) / 1000.0f;
+            }
+        }
+
+        for (int n = 0; n < MP_ARRAY_SIZE(widths); n++) {
+            int w = widths[n] * ax;
+            // Odd start position, so the vector code sees unaligned pointers.
+            int x0 = ax;
+
+            for (int p = 0; p < ref->num_planes; p++) {
+                size_t size = ref->stride[p] * (size_t)mp_image_plane_h(ref, p);
+                memset(ref->planes[p], 0x55, size);
+                memset(out->planes[p], 0x55, size);
+            }
+
+            mp_require(repack_config_buffers(rp, 0, ref, 0, src, NULL));
+            for (int x = 0; x < w; x += ax)
+                repack_line(rp, x0 + x, 0, x0 + x, 0, ax);
+
+            mp_require(repack_config_buffers(rp, 0, out, 0, src, NULL));
+            repack_line(rp, x0, 0, x0, 0, w);
+
+            for (int p = 0; p < ref->num_planes; p++) {
+                for (int y = 0; y < mp_image_plane_h(ref, p); y++) {
+                    assert_memcmp(out->planes[p] + out->stride[p] * y,
+                                  ref->planes[p] + ref->stride[p] * y,
+                                  mp_image_plane_bytes(ref, p, 0, img_w));
+                }
+            }
+        }
+
+        talloc_free(src);
+        talloc_free(ref);
+        talloc_free(out);
+        talloc_free(rp);
+    }
+}
+
 static bool try_draw_bmp(FILE *f, int imgfmt)
 {
     bool ok = false;
@@ -514,6 +590,18 @@ int main(int argc, char *argv[])
     check_float_repack(-AV_PIX_FMT_YUVA444P16, PL_COLOR_SYSTEM_BT_709, PL_COLOR_LEVELS_FULL);
     check_float_repack(-AV_PIX_FMT_YUVA444P16, PL_COLOR_SYSTEM_BT_709, PL_COLOR_LEVELS_LIMITED);
 
+    check_wide_repack(IMGFMT_RGBA, 0);
+    check_wide_repack(IMGFMT_RGB0, 0);
+    check_wide_repack(IMGFMT_0RGB, 0);
+    check_wide_repack(IMGFMT_RGBA64, 0);
+    check_wide_repack(-AV_PIX_FMT_YA8, 0);
+    check_wide_repack(-AV_PIX_FMT_YA16, 0);
+    check_wide_repack(IMGFMT_NV12, 0);
+    check_wide_repack(-AV_PIX_FMT_P016, 0);
+    check_wide_repack(IMGFMT_RGBA, REPACK_CREATE_PLANAR_F32);
+    check_wide_repack(-AV_PIX_FMT_GBRAP, REPACK_CREATE_PLANAR_F32);
+    check_wide_repack(-AV_PIX_FMT_GBRAP16, REPACK_CREATE_PLANAR_F32);
+
     // Determine the list of possible draw_bmp input formats. Do this here
     // because it mostly depends on repack and imgformat stuff.
     f = test_open_out(outdir, "draw_bmp.txt");
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libavutil/pixfmt.h>
+
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "test_utils.h"
+#include "video/fmt-conversion.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "video/repack.h"
+
+#define UNFUCK(v) ((v) > 0 ? (v) : pixfmt2imgfmt(-(v)))
+
+// Throughput of full-line repacks, i.e. the vector code paths (if available).
+static void bench_repack(int imgfmt, int flags, int runs)
+{
+    imgfmt = UNFUCK(imgfmt);
+    const int w = 1920;
+
+    for (int pack = 0; pack < 2; pack++) {
+        struct mp_repack *rp = mp_repack_create_planar(imgfmt, pack, flags);
+        mp_require(rp);
+
+        int ax = mp_repack_get_align_x(rp);
+        int ay = mp_repack_get_align_y(rp);
+        struct mp_image *src =
+            mp_image_alloc(mp_repack_get_format_src(rp), w * ax, ay);
+        struct mp_image *dst =
+            mp_image_alloc(mp_repack_get_format_dst(rp), w * ax, ay);
+        mp_require(src && dst);
+        mp_image_clear(src, 0, 0, src->w, src->h);
+        mp_require(repack_config_buffers(rp, 0, dst, 0, src, NULL));
+
+        int64_t start = mp_time_ns();
+        for (int n = 0; n < runs; n++)
+            repack_line(rp, 0, 0, 0, 0, w * ax);
+        double secs = MP_TIME_NS_TO_S(mp_time_ns() - start);
+        printf("%-15s %s%s: %.1f Mpixels/s\n", mp_imgfmt_to_name(imgfmt),
+               pack ? "pack" : "unpack",
+               (flags & REPACK_CREATE_PLANAR_F32) ? " (f32)" : "",
+               (double)w * ax * ay * runs / MPMAX(secs, 1e-9) / 1e6);
+
+        talloc_free(src);
+        talloc_free(dst);
+        talloc_free(rp);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    mp_time_init();
+
+    int runs = argc > 1 ? atoi(argv[1]) : 2000;
+
+    bench_repack(IMGFMT_RGBA, 0, runs);
+    bench_repack(IMGFMT_RGB0, 0, runs);
+    bench_repack(IMGFMT_0RGB, 0, runs);
+    bench_repack(IMGFMT_RGBA64, 0, runs);
+    bench_repack(-AV_PIX_FMT_YA8, 0, runs);
+    bench_repack(-AV_PIX_FMT_YA16, 0, runs);
+    bench_repack(IMGFMT_NV12, 0, runs);
+    bench_repack(-AV_PIX_FMT_P016, 0, runs);
+    bench_repack(IMGFMT_RGBA, REPACK_CREATE_PLANAR_F32, runs);
+    bench_repack(-AV_PIX_FMT_GBRAP, REPACK_CREATE_PLANAR_F32, runs);
+    bench_repack(-AV_PIX_FMT_GBRAP16, REPACK_CREATE_PLANAR_F32, runs);
+    return 0;
+}
@@ -1451,7 +1451,11 @@ static struct mp_decoder *create(struct mp_filter *parent,
     ctx->codec = codec;
     ctx->decoder = talloc_strdup(ctx, decoder);
     ctx->hwdec_swpool = mp_image_pool_new(ctx);
+    // Downloads can alternate between surface sizes after a reinit.
+    mp_image_pool_set_max_free(ctx->hwdec_swpool, 2);
+    mp_image_pool_set_stats(ctx->hwdec_swpool, vd->global, "hwdec-download");
     ctx->dr_pool = mp_image_pool_new(ctx);
+    mp_image_pool_set_stats(ctx->dr_pool, vd->global, "dr");
 
     ctx->public.f = vd;
     ctx->public.control = control;
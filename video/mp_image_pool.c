@@ -32,6 +32,7 @@
 #include "mpv_talloc.h"
 
 #include "common/common.h"
+#include "common/stats.h"
 
 #include "fmt-conversion.h"
 #include "mp_image_pool.h"
@@ -46,10 +47,26 @@ static mp_static_mutex pool_mutex = MP_STATIC_MUTEX_INITIALIZER;
 // can be referenced and unreferenced from other threads. (As long as the image
 // destructors are thread-safe.)
 
+// All images with the same format and size.
+struct pool_bucket {
+    int fmt, w, h;
+    int num_images;             // images in this bucket (referenced or not)
+    // Unreferenced images. Protected by pool_mutex, because unref_image()
+    // appends to it from arbitrary threads. Always allocated with at least
+    // num_images entries, so that unref_image() never needs to reallocate.
+    struct mp_image **free;
+    int num_free;
+};
+
 struct mp_image_pool {
     struct mp_image **images;
     int num_images;
 
+    // Hash table of buckets, indexed by bucket_hash(), linear probing.
+    struct pool_bucket **buckets;
+    int num_buckets;            // number of used entries
+    int buckets_size;           // allocated entries (power of 2 or 0)
+
     int fmt, w, h;
 
     mp_image_allocator allocator;
@@ -57,6 +74,13 @@ struct mp_image_pool {
 
     bool use_lru;
     unsigned int lru_counter;
+
+    int max_free;               // cap for other buckets (0: single size mode)
+
+    struct stats_ctx *stats;
+    int64_t hits;               // recycled images returned
+    int64_t misses;             // images added to the pool
+    int64_t bytes_held;
 };
 
 // Used to gracefully handle the case when the pool is freed while image
@@ -66,6 +90,8 @@ struct image_flags {
     bool referenced;            // outside mp_image reference exists
     bool pool_alive;            // the mp_image_pool references this
     unsigned int order;         // for LRU allocation (basically a timestamp)
+    struct pool_bucket *bucket;
+    int index;                  // in mp_image_pool.images
 };
 
 static void image_pool_destructor(void *ptr)
@@ -83,6 +109,20 @@ struct mp_image_pool *mp_image_pool_new(void *tparent)
     return pool;
 }
 
+static size_t image_bytes(struct mp_image *img)
+{
+    return img->bufs[0] ? img->bufs[0]->size : 0;
+}
+
+static void update_stats(struct mp_image_pool *pool)
+{
+    if (!pool->stats)
+        return;
+    stats_value(pool->stats, "hits", pool->hits);
+    stats_value(pool->stats, "misses", pool->misses);
+    stats_size_value(pool->stats, "bytes-held", pool->bytes_held);
+}
+
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
     for (int n = 0; n < pool->num_images; n++) {
@@ -98,6 +138,93 @@ void mp_image_pool_clear(struct mp_image_pool *pool)
             talloc_free(img);
     }
     pool->num_images = 0;
+
+    // No image refers to the buckets anymore.
+    for (int n = 0; n < pool->buckets_size; n++)
+        TA_FREEP(&pool->buckets[n]);
+    pool->num_buckets = 0;
+
+    pool->bytes_held = 0;
+    update_stats(pool);
+}
+
+static unsigned int bucket_hash(int fmt, int w, int h)
+{
+    uint32_t hash = fmt * 0x9E3779B1u;
+    hash = (hash ^ (uint32_t)w) * 0x85EBCA77u;
+    hash = (hash ^ (uint32_t)h) * 0xC2B2AE3Du;
+    return hash ^ (hash >> 16);
+}
+
+static struct pool_bucket *find_bucket(struct mp_image_pool *pool, int fmt,
+                                       int w, int h, bool create)
+{
+    if (!pool->buckets_size && !create)
+        return NULL;
+
+    if (create && (pool->num_buckets + 1) * 2 > pool->buckets_size) {
+        // Rehash; this is only done when a new format/size is seen.
+        struct pool_bucket **old = pool->buckets;
+        int old_size = pool->buckets_size;
+        pool->buckets_size = MPMAX(old_size * 2, 8);
+        pool->buckets = talloc_zero_array(pool, struct pool_bucket *,
+                                          pool->buckets_size);
+        for (int n = 0; n < old_size; n++) {
+            struct pool_bucket *b = old[n];
+            if (!b)
+                continue;
+            unsigned int mask = pool->buckets_size - 1;
+            unsigned int i = bucket_hash(b->fmt, b->w, b->h) & mask;
+            while (pool->buckets[i])
+                i = (i + 1) & mask;
+            pool->buckets[i] = b;
+        }
+        talloc_free(old);
+    }
+
+    unsigned int mask = pool->buckets_size - 1;
+    unsigned int i = bucket_hash(fmt, w, h) & mask;
+    while (pool->buckets[i]) {
+        struct pool_bucket *b = pool->buckets[i];
+        if (b->fmt == fmt && b->w == w && b->h == h)
+            return b;
+        i = (i + 1) & mask;
+    }
+
+    if (!create)
+        return NULL;
+
+    struct pool_bucket *b = talloc_zero(pool, struct pool_bucket);
+    b->fmt = fmt;
+    b->w = w;
+    b->h = h;
+    pool->buckets[i] = b;
+    pool->num_buckets++;
+    return b;
+}
+
+// Remove the unreferenced image at b->free[n] from the pool and free it.
+static void remove_free_image(struct mp_image_pool *pool, struct pool_bucket *b,
+                              int n)
+{
+    pool_lock();
+    struct mp_image *img = b->free[n];
+    struct image_flags *it = img->priv;
+    mp_assert(!it->referenced && it->pool_alive);
+    it->pool_alive = false;
+    MP_TARRAY_REMOVE_AT(b->free, b->num_free, n);
+    b->num_images--;
+    pool_unlock();
+
+    pool->bytes_held -= image_bytes(img);
+
+    int index = it->index;
+    mp_assert(pool->images[index] == img);
+    pool->images[index] = pool->images[pool->num_images - 1];
+    ((struct image_flags *)pool->images[index]->priv)->index = index;
+    pool->num_images--;
+
+    talloc_free(img);
 }
 
 // This is the only function that is allowed to run in a different thread.
@@ -111,6 +238,11 @@ static void unref_image(void *opaque, uint8_t *data)
     mp_assert(it->referenced);
     it->referenced = false;
     alive = it->pool_alive;
+    if (alive) {
+        struct pool_bucket *b = it->bucket;
+        mp_assert(b->num_free < b->num_images);
+        b->free[b->num_free++] = img;
+    }
     pool_unlock();
     if (!alive)
         talloc_free(img);
@@ -121,24 +253,24 @@ static void unref_image(void *opaque, uint8_t *data)
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h)
 {
+    struct pool_bucket *b = find_bucket(pool, fmt, w, h, false);
+    if (!b)
+        return NULL;
+
     struct mp_image *new = NULL;
     pool_lock();
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
-        struct image_flags *img_it = img->priv;
-        mp_assert(img_it->pool_alive);
-        if (!img_it->referenced) {
-            if (img->imgfmt == fmt && img->w == w && img->h == h) {
-                if (pool->use_lru) {
-                    struct image_flags *new_it = new ? new->priv : NULL;
-                    if (!new_it || new_it->order > img_it->order)
-                        new = img;
-                } else {
-                    new = img;
-                    break;
-                }
+    if (b->num_free) {
+        int sel = b->num_free - 1;
+        if (pool->use_lru) {
+            for (int n = 0; n < b->num_free; n++) {
+                struct image_flags *sel_it = b->free[sel]->priv;
+                struct image_flags *img_it = b->free[n]->priv;
+                if (sel_it->order > img_it->order)
+                    sel = n;
             }
         }
+        new = b->free[sel];
+        MP_TARRAY_REMOVE_AT(b->free, b->num_free, sel);
     }
     pool_unlock();
     if (!new)
@@ -160,22 +292,67 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                     unref_image, new, flags);
     if (!ref->bufs[0]) {
         talloc_free(ref);
+        // Put it back; it's still unreferenced.
+        pool_lock();
+        b->free[b->num_free++] = new;
+        pool_unlock();
         return NULL;
     }
 
     struct image_flags *it = new->priv;
     mp_assert(!it->referenced && it->pool_alive);
     it->referenced = true;
+    // Reporting takes the stats lock, so don't do it on every recycled image.
+    // Allocations (i.e. misses) always update all values.
+    if (it->order && (++pool->hits % 64) == 0)
+        update_stats(pool);
     it->order = ++pool->lru_counter;
     return ref;
 }
 
 void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new)
 {
+    struct pool_bucket *b = find_bucket(pool, new->imgfmt, new->w, new->h, true);
+
     struct image_flags *it = talloc_ptrtype(new, it);
-    *it = (struct image_flags) { .pool_alive = true };
+    *it = (struct image_flags) {
+        .pool_alive = true,
+        .bucket = b,
+        .index = pool->num_images,
+    };
     new->priv = it;
     MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
+
+    pool_lock();
+    b->num_images++;
+    MP_TARRAY_GROW(b, b->free, b->num_images - 1);
+    b->free[b->num_free++] = new;
+    pool_unlock();
+
+    pool->misses++;
+    pool->bytes_held += image_bytes(new);
+    update_stats(pool);
+}
+
+// Free unused images above the limit in all buckets except the one for the
+// given format/size. (Other threads can only add free images, so the count
+// can't drop below the limit during this.)
+static void trim_buckets(struct mp_image_pool *pool, int fmt, int w, int h)
+{
+    for (int n = 0; n < pool->buckets_size; n++) {
+        struct pool_bucket *b = pool->buckets[n];
+        if (!b || (b->fmt == fmt && b->w == w && b->h == h))
+            continue;
+        while (1) {
+            pool_lock();
+            int num_free = b->num_free;
+            pool_unlock();
+            if (num_free <= pool->max_free)
+                break;
+            remove_free_image(pool, b, 0);
+        }
+    }
+    update_stats(pool);
 }
 
 // Return a new image of given format/size. The only difference to
@@ -191,7 +368,8 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
         return mp_image_alloc(fmt, w, h);
     struct mp_image *new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
     if (!new) {
-        if (fmt != pool->fmt || w != pool->w || h != pool->h)
+        if (!pool->max_free &&
+            (fmt != pool->fmt || w != pool->w || h != pool->h))
             mp_image_pool_clear(pool);
         pool->fmt = fmt;
         pool->w = w;
@@ -203,6 +381,10 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
         }
         if (!new)
             return NULL;
+        // Allocating is when switching between sizes would make unused
+        // images of other sizes accumulate.
+        if (pool->max_free)
+            trim_buckets(pool, fmt, w, h);
         mp_image_pool_add(pool, new);
         new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
     }
@@ -257,6 +439,27 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
     pool->use_lru = true;
 }
 
+// Keep unused images of all formats and sizes, instead of freeing the pool
+// contents each time mp_image_pool_get() is called with a new format or size.
+// At most max_free unused images are kept per format/size combination, except
+// for the one that was last allocated, which is not limited.
+void mp_image_pool_set_max_free(struct mp_image_pool *pool, int max_free)
+{
+    mp_assert(max_free > 0);
+    pool->max_free = max_free;
+}
+
+// Report pool statistics (recycled and allocated images, memory held) under
+// "image-pool/<name>".
+void mp_image_pool_set_stats(struct mp_image_pool *pool,
+                             struct mpv_global *global, const char *name)
+{
+    talloc_free(pool->stats);
+    pool->stats = stats_ctx_create(pool, global,
+                                   mp_tprintf(80, "image-pool/%s", name));
+    update_stats(pool);
+}
+
 // Return the sw image format mp_image_hw_download() would use. This can be
 // different from src->params.hw_subfmt in obscure cases.
 int mp_image_hw_download_get_sw_format(struct mp_image *src)
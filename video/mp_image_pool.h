@@ -13,6 +13,11 @@ void mp_image_pool_add(struct mp_image_pool *pool, struct mp_image *new);
 void mp_image_pool_clear(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
+void mp_image_pool_set_max_free(struct mp_image_pool *pool, int max_free);
+
+struct mpv_global;
+void mp_image_pool_set_stats(struct mp_image_pool *pool,
+                             struct mpv_global *global, const char *name);
 
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
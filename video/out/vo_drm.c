@@ -29,6 +29,7 @@
 #include "drm_atomic.h"
 #include "drm_common.h"
 #include "osdep/timer.h"
+#include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "video/fmt-conversion.h"
 #include "video/mp_image.h"
@@ -59,8 +60,8 @@ struct priv {
     enum mp_imgfmt imgfmt;
 
     struct mp_image *last_input;
-    struct mp_image *cur_frame;
-    struct mp_image *cur_frame_cropped;
+    struct mp_image *cur_frame;     // for blending OSD in cached memory
+    struct mp_draw_sub_cache *osd_cache;
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_osd_res osd;
@@ -204,15 +205,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
         .p_h = 1,
     };
 
-    talloc_free(p->cur_frame);
-    p->cur_frame = mp_image_alloc(p->imgfmt, drm->fb->width, drm->fb->height);
     mp_image_params_guess_csp(&p->sws->dst);
-    mp_image_set_params(p->cur_frame, &p->sws->dst);
-    mp_image_set_size(p->cur_frame, drm->fb->width, drm->fb->height);
 
-    talloc_free(p->cur_frame_cropped);
-    p->cur_frame_cropped = mp_image_new_dummy_ref(p->cur_frame);
-    mp_image_crop_rc(p->cur_frame_cropped, p->dst);
+    TA_FREEP(&p->cur_frame);
 
     talloc_free(p->last_input);
     p->last_input = NULL;
@@ -227,12 +222,32 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     return 0;
 }
 
+static bool fb_is_queued(struct vo *vo, struct framebuffer *fb)
+{
+    struct priv *p = vo->priv;
+
+    for (unsigned int n = 0; n < p->fb_queue_len; n++) {
+        if (p->fb_queue[n]->fb == fb)
+            return true;
+    }
+    return false;
+}
+
+// Frames are rendered directly into the dumb buffers, so pick one which is
+// neither on screen nor waiting in the swapchain, if possible.
 static struct framebuffer *get_new_fb(struct vo *vo)
 {
     struct priv *p = vo->priv;
 
-    p->front_buf++;
-    p->front_buf %= p->buf_count;
+    int next = (p->front_buf + 1) % p->buf_count;
+    for (int n = 0; n < p->buf_count; n++) {
+        int i = (p->front_buf + 1 + n) % p->buf_count;
+        if (!fb_is_queued(vo, p->bufs[i])) {
+            next = i;
+            break;
+        }
+    }
+    p->front_buf = next;
 
     return p->bufs[p->front_buf];
 }
@@ -243,6 +258,33 @@ static void draw_image(struct vo *vo, mp_image_t *mpi, struct framebuffer *buf)
     struct vo_drm_state *drm = vo->drm;
 
     if (drm->active && buf != NULL) {
+        struct sub_bitmap_list *osd_list =
+            osd_render(vo->osd, p->osd, mpi ? mpi->pts : 0, 0,
+                       mp_draw_sub_formats);
+
+        struct mp_image fb_img = {0};
+        mp_image_set_params(&fb_img, &p->sws->dst);
+        mp_image_set_size(&fb_img, buf->width, buf->height);
+        fb_img.planes[0] = buf->map;
+        fb_img.stride[0] = buf->stride;
+
+        // Blending reads back the destination, which is very slow on the
+        // (usually write-combined) dumb buffer mapping. So render directly
+        // into it only if there is no OSD, and otherwise render into cached
+        // memory and copy the result.
+        struct mp_image *img = &fb_img;
+        if (osd_list->num_items) {
+            if (!p->cur_frame) {
+                p->cur_frame = mp_image_alloc(p->imgfmt, buf->width, buf->height);
+                if (p->cur_frame) {
+                    mp_image_set_params(p->cur_frame, &p->sws->dst);
+                    mp_image_set_size(p->cur_frame, buf->width, buf->height);
+                }
+            }
+            if (p->cur_frame)
+                img = p->cur_frame;
+        }
+
         if (mpi) {
             struct mp_image src = *mpi;
             struct mp_rect src_rc = p->src;
@@ -250,22 +292,28 @@ static void draw_image(struct vo *vo, mp_image_t *mpi, struct framebuffer *buf)
             src_rc.y0 = MP_ALIGN_DOWN(src_rc.y0, mpi->fmt.align_y);
             mp_image_crop_rc(&src, src_rc);
 
-            mp_image_clear(p->cur_frame, 0, 0, p->cur_frame->w, p->dst.y0);
-            mp_image_clear(p->cur_frame, 0, p->dst.y1, p->cur_frame->w, p->cur_frame->h);
-            mp_image_clear(p->cur_frame, 0, p->dst.y0, p->dst.x0, p->dst.y1);
-            mp_image_clear(p->cur_frame, p->dst.x1, p->dst.y0, p->cur_frame->w, p->dst.y1);
+            mp_image_clear(img, 0, 0, img->w, p->dst.y0);
+            mp_image_clear(img, 0, p->dst.y1, img->w, img->h);
+            mp_image_clear(img, 0, p->dst.y0, p->dst.x0, p->dst.y1);
+            mp_image_clear(img, p->dst.x1, p->dst.y0, img->w, p->dst.y1);
 
-            mp_sws_scale(p->sws, p->cur_frame_cropped, &src);
-            osd_draw_on_image(vo->osd, p->osd, src.pts, 0, p->cur_frame);
+            struct mp_image dst = *img;
+            mp_image_crop_rc(&dst, p->dst);
+            mp_sws_scale(p->sws, &dst, &src);
         } else {
-            mp_image_clear(p->cur_frame, 0, 0, p->cur_frame->w, p->cur_frame->h);
-            osd_draw_on_image(vo->osd, p->osd, 0, 0, p->cur_frame);
+            mp_image_clear(img, 0, 0, img->w, img->h);
         }
 
-        memcpy_pic(buf->map, p->cur_frame->planes[0],
-                   p->cur_frame->w * BYTES_PER_PIXEL, p->cur_frame->h,
-                   buf->stride,
-                   p->cur_frame->stride[0]);
+        if (osd_list->num_items) {
+            if (!mp_draw_sub_bitmaps(p->osd_cache, img, osd_list))
+                MP_WARN(vo, "Failed rendering OSD.\n");
+        }
+        talloc_free(osd_list);
+
+        if (img != &fb_img) {
+            memcpy_pic(buf->map, img->planes[0], img->w * BYTES_PER_PIXEL,
+                       img->h, buf->stride, img->stride[0]);
+        }
     }
 
     if (mpi != p->last_input) {
@@ -378,7 +426,6 @@ static void uninit(struct vo *vo)
 
     talloc_free(p->last_input);
     talloc_free(p->cur_frame);
-    talloc_free(p->cur_frame_cropped);
 }
 
 static int preinit(struct vo *vo)
@@ -413,6 +460,7 @@ static int preinit(struct vo *vo)
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
+    p->osd_cache = mp_draw_sub_alloc(p, vo->global);
     return 0;
 
 err:
@@ -22,10 +22,13 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 
+#include <libavutil/cpu.h>
 #include <libswscale/swscale.h>
 
 #include "misc/bstr.h"
+#include "misc/thread_pool.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "options/m_config.h"
 #include "options/path.h"
 #include "mpv_talloc.h"
@@ -49,6 +52,7 @@ static const struct m_sub_options image_writer_conf = {
 struct vo_image_opts {
     struct image_writer_opts *opts;
     char *outdir;
+    int threads;
 };
 
 #define OPT_BASE_STRUCT struct vo_image_opts
@@ -57,9 +61,14 @@ static const struct m_sub_options vo_image_conf = {
     .opts = (const struct m_option[]) {
         {"vo-image", OPT_SUBSTRUCT(opts, image_writer_conf)},
         {"vo-image-outdir", OPT_STRING(outdir), .flags = M_OPT_FILE},
+        {"vo-image-threads", OPT_CHOICE(threads, {"auto", 0}),
+            M_RANGE(1, 64)},
         {0},
     },
     .size = sizeof(struct vo_image_opts),
+    .defaults = &(const struct vo_image_opts){
+        .threads = 1,
+    },
 };
 
 struct priv {
@@ -68,6 +77,20 @@ struct priv {
     struct mp_image *current;
     char *dir;
     int frame;
+
+    // Only set if frames are written on worker threads.
+    struct mp_thread_pool *pool;
+    int max_pending;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    int pending;        // jobs queued or being written (protected by lock)
+};
+
+struct write_job {
+    struct vo *vo;
+    struct mp_image *image;
+    char *filename;
 };
 
 static bool checked_mkdir(struct vo *vo, const char *buf)
@@ -88,6 +111,33 @@ static bool checked_mkdir(struct vo *vo, const char *buf)
     return true;
 }
 
+static void write_thread(void *ctx)
+{
+    struct write_job *job = ctx;
+    struct vo *vo = job->vo;
+    struct priv *p = vo->priv;
+
+    write_image(job->image, p->opts->opts, job->filename, vo->global, vo->log,
+                true);
+    talloc_free(job);
+
+    mp_mutex_lock(&p->lock);
+    p->pending--;
+    mp_cond_broadcast(&p->wakeup);
+    mp_mutex_unlock(&p->lock);
+}
+
+// Wait until at most max_pending frames are still being written.
+static void wait_pending(struct vo *vo, int max_pending)
+{
+    struct priv *p = vo->priv;
+
+    mp_mutex_lock(&p->lock);
+    while (p->pending > max_pending)
+        mp_cond_wait(&p->wakeup, &p->lock);
+    mp_mutex_unlock(&p->lock);
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     return 0;
@@ -124,9 +174,38 @@ static void flip_page(struct vo *vo)
         filename = mp_path_join(t, p->dir, filename);
 
     MP_INFO(vo, "Saving %s\n", filename);
-    write_image(p->current, p->opts->opts, filename, vo->global, vo->log, true);
 
+    if (!p->pool) {
+        write_image(p->current, p->opts->opts, filename, vo->global, vo->log,
+                    true);
+        talloc_free(t);
+        return;
+    }
+
+    // The file name is fixed here, so the numbering follows the frame order
+    // no matter in which order the workers finish.
+    struct write_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct write_job){
+        .vo = vo,
+        .image = mp_image_new_ref(p->current),
+        .filename = talloc_steal(job, filename),
+    };
     talloc_free(t);
+    if (!job->image) {
+        MP_ERR(vo, "Could not reference frame, skipping %s\n", job->filename);
+        talloc_free(job);
+        return;
+    }
+    talloc_steal(job, job->image);
+
+    // Don't let the decoder run arbitrarily far ahead of the writers.
+    wait_pending(vo, p->max_pending - 1);
+
+    mp_mutex_lock(&p->lock);
+    p->pending++;
+    mp_mutex_unlock(&p->lock);
+
+    mp_thread_pool_queue(p->pool, write_thread, job);
 }
 
 static int query_format(struct vo *vo, int fmt)
@@ -138,6 +217,12 @@ static int query_format(struct vo *vo, int fmt)
 
 static void uninit(struct vo *vo)
 {
+    struct priv *p = vo->priv;
+
+    // Freeing the pool waits for all queued frames to be written.
+    TA_FREEP(&p->pool);
+    mp_cond_destroy(&p->wakeup);
+    mp_mutex_destroy(&p->lock);
 }
 
 static int preinit(struct vo *vo)
@@ -146,6 +231,22 @@ static int preinit(struct vo *vo)
     p->opts = mp_get_config_group(vo, vo->global, &vo_image_conf);
     if (p->opts->outdir && !checked_mkdir(vo, p->opts->outdir))
         return -1;
+    mp_mutex_init(&p->lock);
+    mp_cond_init(&p->wakeup);
+
+    int threads = p->opts->threads;
+    if (!threads)
+        threads = MPCLAMP(av_cpu_count(), 1, 64);
+    if (threads > 1) {
+        p->pool = mp_thread_pool_create(p, threads, threads, threads);
+        if (p->pool) {
+            MP_VERBOSE(vo, "Using %d writer threads.\n", threads);
+        } else {
+            MP_WARN(vo, "Failed to create writer threads, writing frames "
+                        "synchronously.\n");
+        }
+        p->max_pending = threads * 2;
+    }
     return 0;
 }
 
@@ -31,9 +31,15 @@
 #include <unistd.h>
 #endif
 
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include <libswscale/swscale.h>
 #include <libavutil/base64.h>
 
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 #include "options/m_config.h"
 #include "osdep/terminal.h"
 #include "sub/osd.h"
@@ -78,6 +84,7 @@ static inline void write_str(unsigned char* s)
 }
 
 #define KITTY_ESC_IMG        "\033_Ga=T,f=24,s=%d,v=%d,C=1,q=2,m=1;"
+#define KITTY_ESC_IMG_ZLIB   "\033_Ga=T,f=24,s=%d,v=%d,C=1,q=2,o=z,m=1;"
 #define KITTY_ESC_IMG_SHM    "\033_Ga=T,t=s,f=24,s=%d,v=%d,C=1,q=2,m=1;%s"
 #define KITTY_ESC_CONTINUE   "\033_Gm=%d;"
 static const bstr KITTY_ESC_END = bstr0_lit("\033\\");
@@ -92,6 +99,8 @@ struct vo_kitty_opts {
     bool config_clear, alt_screen;
     bool use_shm;
     bool auto_multiplexer_passthrough;
+    bool compress;
+    bool skip_identical;
 };
 
 struct priv {
@@ -114,6 +123,23 @@ struct priv {
     struct mp_osd_res osd;
     struct mp_image *frame;
     struct mp_sws_context *sws;
+
+    // Without shm: the last frame handed to the terminal (or the writer).
+    uint8_t *sent_buffer;
+    bool sent_valid;
+    bool skip_frame;
+
+    // With compression, frames are compressed, encoded and written by the
+    // writer thread while the next frame is being scaled.
+    struct mp_thread_pool *writer;
+    struct mp_waiter writer_waiter;
+    bool writer_active;
+#if HAVE_ZLIB
+    z_stream zstream;
+    bool zstream_ok;
+    uint8_t *zbuf;
+    size_t zbuf_size;
+#endif
 };
 
 #if HAVE_POSIX
@@ -128,25 +154,27 @@ static inline void write_bstr_passthrough(struct priv *p, bstr bs)
     write_bstr(p->dcs_suffix);
 }
 
+// Note: the command buffer is not allocated under p, because it can be built
+// on the writer thread.
 static inline void append_passthrough(struct priv *p, bstr *bs, bstr append)
 {
-    bstr_xappend(p, bs, p->dcs_prefix);
-    bstr_xappend(p, bs, append);
-    bstr_xappend(p, bs, p->dcs_suffix);
+    bstr_xappend(NULL, bs, p->dcs_prefix);
+    bstr_xappend(NULL, bs, append);
+    bstr_xappend(NULL, bs, p->dcs_suffix);
 }
 
 MP_PRINTF_ATTRIBUTE(3, 4)
 static inline void append_asprintf_passthrough(struct priv *p, bstr *bs,
                                                      const char *fmt, ...)
 {
-    bstr_xappend(p, bs, p->dcs_prefix);
+    bstr_xappend(NULL, bs, p->dcs_prefix);
 
     va_list ap;
     va_start(ap, fmt);
-    bstr_xappend_vasprintf(p, bs, fmt, ap);
+    bstr_xappend_vasprintf(NULL, bs, fmt, ap);
     va_end(ap);
 
-    bstr_xappend(p, bs, p->dcs_suffix);
+    bstr_xappend(NULL, bs, p->dcs_suffix);
 }
 
 static void close_shm(struct priv *p)
@@ -163,12 +191,27 @@ static void close_shm(struct priv *p)
 #endif
 }
 
+static void wait_writer(struct priv *p)
+{
+    if (!p->writer_active)
+        return;
+    mp_waiter_wait(&p->writer_waiter);
+    p->writer_active = false;
+}
+
 static void free_bufs(struct vo* vo)
 {
     struct priv* p = vo->priv;
 
+    wait_writer(p);
+
     talloc_free(p->frame);
     talloc_free(p->output);
+    TA_FREEP(&p->sent_buffer);
+    p->sent_valid = false;
+#if HAVE_ZLIB
+    TA_FREEP(&p->zbuf);
+#endif
 
     if (p->opts.use_shm) {
         close_shm(p);
@@ -214,6 +257,12 @@ static void set_out_params(struct vo *vo)
 
     p->buffer_size = 3 * p->width * p->height;
     p->output_size = AV_BASE64_SIZE(p->buffer_size);
+#if HAVE_ZLIB
+    if (p->opts.compress) {
+        p->zbuf_size = deflateBound(&p->zstream, p->buffer_size);
+        p->output_size = AV_BASE64_SIZE(p->zbuf_size);
+    }
+#endif
 }
 
 static int reconfig(struct vo *vo, struct mp_image_params *params)
@@ -222,6 +271,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
 
     vo->want_redraw = true;
 
+    wait_writer(p);
     write_bstr_passthrough(p, KITTY_ESC_DELETE_ALL);
     write_bstr_passthrough(p, KITTY_ESC_END);
 
@@ -253,7 +303,12 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (!p->opts.use_shm) {
         p->buffer = talloc_array(NULL, uint8_t, p->buffer_size);
         p->output = talloc_array(NULL, char, p->output_size);
+        p->sent_buffer = talloc_array(NULL, uint8_t, p->buffer_size);
     }
+#if HAVE_ZLIB
+    if (p->opts.compress)
+        p->zbuf = talloc_array(NULL, uint8_t, p->zbuf_size);
+#endif
 
     return 0;
 }
@@ -329,7 +384,11 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     memcpy_pic(p->buffer, p->frame->planes[0], p->width * BYTES_PER_PX,
                p->height, p->width * BYTES_PER_PX, p->frame->stride[0]);
 
-    if (!p->opts.use_shm)
+    // The writer thread only reads sent_buffer, so comparing is safe.
+    p->skip_frame = p->opts.skip_identical && p->sent_valid &&
+                    !memcmp(p->buffer, p->sent_buffer, p->buffer_size);
+
+    if (!p->opts.use_shm && !p->opts.compress && !p->skip_frame)
         av_base64_encode(p->output, p->output_size, p->buffer, p->buffer_size);
 
 done:
@@ -337,12 +396,72 @@ done:
     return VO_TRUE;
 }
 
+static void append_image(struct priv *p, const char *data, int data_size,
+                         bool compressed)
+{
+    append_asprintf_passthrough(p, &p->cmd,
+                                compressed ? KITTY_ESC_IMG_ZLIB : KITTY_ESC_IMG,
+                                p->width, p->height);
+
+    int offset = 0;
+
+    for (; offset < data_size; ) {
+        int chunk = MPMIN(4096, data_size - offset);
+
+        if (offset > 0)
+            append_asprintf_passthrough(p, &p->cmd, KITTY_ESC_CONTINUE,
+                                        offset + chunk < data_size);
+
+        // Append at max chunk bytes
+        bstr_xappend(NULL, &p->cmd, (bstr){(char *)data + offset, chunk});
+        append_passthrough(p, &p->cmd, KITTY_ESC_END);
+        offset += chunk;
+    }
+
+    // When the data is less than or equal to chunk size the final packet
+    // isn't sent, i.e. an escape sequence with `m=0`.
+    // This ensures that an escape sequence with `m=0` is sent and
+    // terminals stay happy
+    if (offset == 0) {
+        append_asprintf_passthrough(p, &p->cmd, KITTY_ESC_CONTINUE, 0);
+        append_passthrough(p, &p->cmd, KITTY_ESC_END);
+    }
+}
+
+#if HAVE_ZLIB
+static void write_compressed(void *ptr)
+{
+    struct priv *p = ptr;
+
+    p->zstream.next_in = p->sent_buffer;
+    p->zstream.avail_in = p->buffer_size;
+    p->zstream.next_out = p->zbuf;
+    p->zstream.avail_out = p->zbuf_size;
+    // Can't fail with an output buffer of deflateBound() size.
+    deflate(&p->zstream, Z_FINISH);
+    size_t size = p->zbuf_size - p->zstream.avail_out;
+    deflateReset(&p->zstream);
+
+    av_base64_encode(p->output, p->output_size, p->zbuf, size);
+    append_image(p, p->output, AV_BASE64_SIZE(size) - 1, true);
+    write_bstr(p->cmd);
+
+    mp_waiter_wakeup(&p->writer_waiter, 0);
+}
+#endif
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
     if (!p->buffer)
         return;
 
+    if (p->skip_frame)
+        return;
+
+    // The writer may still be using the command buffer.
+    wait_writer(p);
+
     p->cmd.len = 0;
 
     // Start with ESC to position the cursor
@@ -357,33 +476,21 @@ static void flip_page(struct vo *vo)
             return;
         }
 
-        append_asprintf_passthrough(p, &p->cmd, KITTY_ESC_IMG,
-                                    p->width, p->height);
-
-        int output_size = p->output_size - 1;
-        int offset = 0;
-
-        for (; offset < output_size; ) {
-            int chunk = MPMIN(4096, output_size - offset);
+        // Keep this frame for comparison; the next one is drawn into the
+        // other buffer.
+        MPSWAP(uint8_t *, p->buffer, p->sent_buffer);
+        p->sent_valid = true;
 
-            if (offset > 0)
-                append_asprintf_passthrough(p, &p->cmd, KITTY_ESC_CONTINUE,
-                                            offset + chunk < output_size);
-
-            // Append at max chunk bytes
-            bstr_xappend(p, &p->cmd, (bstr){p->output + offset, chunk});
-            append_passthrough(p, &p->cmd, KITTY_ESC_END);
-            offset += chunk;
+#if HAVE_ZLIB
+        if (p->writer) {
+            p->writer_waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+            p->writer_active = true;
+            mp_thread_pool_queue(p->writer, write_compressed, p);
+            return;
         }
+#endif
 
-        // When the data is less than or equal to chunk size the final packet
-        // isn't sent, i.e. an escape sequence with `m=0`.
-        // This ensures that an escape sequence with `m=0` is sent and
-        // terminals stay happy
-        if (offset == 0) {
-            append_asprintf_passthrough(p, &p->cmd, KITTY_ESC_CONTINUE, 0);
-            append_passthrough(p, &p->cmd, KITTY_ESC_END);
-        }
+        append_image(p, p->output, p->output_size - 1, false);
     }
 
     write_bstr(p->cmd);
@@ -432,6 +539,29 @@ static int preinit(struct vo *vo)
     }
 #endif
 
+    if (p->opts.compress) {
+#if HAVE_ZLIB
+        if (p->opts.use_shm) {
+            MP_WARN(vo, "Compression has no effect with shared memory.\n");
+            p->opts.compress = false;
+        } else {
+            if (deflateInit(&p->zstream, Z_BEST_SPEED) != Z_OK) {
+                MP_ERR(vo, "Failed to initialize zlib.\n");
+                return -1;
+            }
+            p->zstream_ok = true;
+            p->writer = mp_thread_pool_create(p, 1, 1, 1);
+            if (!p->writer) {
+                MP_ERR(vo, "Failed to create writer thread.\n");
+                return -1;
+            }
+        }
+#else
+        MP_ERR(vo, "Compression requires mpv to be built with zlib.\n");
+        return -1;
+#endif
+    }
+
     if (p->opts.auto_multiplexer_passthrough) {
         if (getenv("TMUX")) {
             p->dcs_prefix = DCS_TMUX_PREFIX;
@@ -471,6 +601,9 @@ static void uninit(struct vo *vo)
     sigaction(SIGWINCH, &saved_sigaction, NULL);
 #endif
 
+    wait_writer(p);
+    TA_FREEP(&p->writer);
+
     write_bstr_passthrough(p, KITTY_ESC_DELETE_ALL);
 
     write_str(TERM_ESC_RESTORE_CURSOR);
@@ -484,6 +617,11 @@ static void uninit(struct vo *vo)
     }
 
     free_bufs(vo);
+    talloc_free(p->cmd.start);
+#if HAVE_ZLIB
+    if (p->zstream_ok)
+        deflateEnd(&p->zstream);
+#endif
 }
 
 #define OPT_BASE_STRUCT struct priv
@@ -515,6 +653,8 @@ const struct vo_driver video_out_kitty = {
         {"alt-screen", OPT_BOOL(opts.alt_screen), },
         {"use-shm", OPT_BOOL(opts.use_shm), },
         {"auto-multiplexer-passthrough", OPT_BOOL(opts.auto_multiplexer_passthrough), },
+        {"compress", OPT_BOOL(opts.compress), },
+        {"skip-identical", OPT_BOOL(opts.skip_identical), },
         {0}
     },
     .options_prefix = "vo-kitty",
@@ -22,14 +22,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 
 #include <libplacebo/utils/libav.h>
 
 #include "common/common.h"
+#include "common/msg.h"
 #include "options/options.h"
+#include "misc/bstr.h"
 #include "misc/lavc_compat.h"
+#include "osdep/threads.h"
 #include "video/fmt-conversion.h"
 #include "video/mp_image.h"
+#include "video/sws_utils.h"
 #include "mpv_talloc.h"
 #include "vo.h"
 
@@ -37,12 +43,202 @@
 
 #include "sub/osd.h"
 
+// Maximum number of frames buffered for each rendition before draw_frame()
+// blocks.
+#define RENDITION_QUEUE_SIZE 4
+
+// An additional output file (--orenditions), encoded from the same frames on
+// a separate thread.
+struct rendition {
+    struct mp_log *log;
+
+    // Parsed from the option.
+    int w, h;           // 0 means derived from the other one
+    char *bitrate;      // NULL or passed as "b" encoder option
+    char *file;
+
+    struct encode_lavc_context *ectx;
+    struct encoder_context *enc;
+    struct mp_sws_context *sws;
+    int imgfmt;
+
+    mp_thread thread;
+    bool thread_valid;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    // --- protected by lock
+    struct mp_image **queue;
+    int num_queue;
+    bool terminate;
+};
+
 struct priv {
     struct encoder_context *enc;
 
+    struct rendition **renditions;
+    int num_renditions;
+
     bool shutdown;
 };
 
+// Parse "<w>x<h>:<bitrate>:<file>". Either dimension can be 0, and bitrate can
+// be empty.
+static bool parse_rendition(struct rendition *r, const char *s)
+{
+    bstr rest = bstr0(s), size, bitrate;
+    if (!bstr_split_tok(rest, ":", &size, &rest) ||
+        !bstr_split_tok(rest, ":", &bitrate, &rest) || !rest.len)
+        return false;
+
+    r->w = bstrtoll(size, &size, 10);
+    if (!bstr_eatstart0(&size, "x"))
+        return false;
+    r->h = bstrtoll(size, &size, 10);
+    if (size.len || r->w < 0 || r->h < 0 || (!r->w && !r->h))
+        return false;
+
+    r->bitrate = bitrate.len ? bstrto0(r, bitrate) : NULL;
+    r->file = bstrto0(r, rest);
+    return true;
+}
+
+static void encode_rendition_frame(struct rendition *r, struct mp_image *mpi)
+{
+    AVCodecContext *avc = r->enc->encoder;
+
+    struct mp_image *img = mp_image_alloc(r->imgfmt, r->w, r->h);
+    MP_HANDLE_OOM(img);
+    img->params.color = mpi->params.color;
+    img->params.repr = mpi->params.repr;
+    img->params.chroma_location = mpi->params.chroma_location;
+    if (mp_sws_scale(r->sws, img, mpi) < 0) {
+        MP_ERR(r, "Scaling to %dx%d failed.\n", r->w, r->h);
+        talloc_free(img);
+        return;
+    }
+
+    AVFrame *frame = mp_image_to_av_frame(img);
+    MP_HANDLE_OOM(frame);
+    talloc_free(img);
+
+    frame->pts = rint(mpi->pts * av_q2d(av_inv_q(avc->time_base)));
+    frame->pict_type = 0;
+    frame->quality = avc->global_quality;
+    encoder_encode(r->enc, frame);
+    av_frame_free(&frame);
+}
+
+static MP_THREAD_VOID rendition_thread(void *arg)
+{
+    struct rendition *r = arg;
+    mp_thread_set_name("vo-lavc-rendition");
+
+    mp_mutex_lock(&r->lock);
+    while (r->num_queue || !r->terminate) {
+        if (!r->num_queue) {
+            mp_cond_wait(&r->wakeup, &r->lock);
+            continue;
+        }
+        struct mp_image *mpi = r->queue[0];
+        MP_TARRAY_REMOVE_AT(r->queue, r->num_queue, 0);
+        mp_cond_broadcast(&r->wakeup);
+        mp_mutex_unlock(&r->lock);
+
+        encode_rendition_frame(r, mpi);
+        talloc_free(mpi);
+
+        mp_mutex_lock(&r->lock);
+    }
+    mp_mutex_unlock(&r->lock);
+
+    encoder_encode(r->enc, NULL); // finish encoding
+    MP_THREAD_RETURN();
+}
+
+// Takes ownership of mpi. Blocks if the rendition's queue is full.
+static void queue_rendition_frame(struct rendition *r, struct mp_image *mpi)
+{
+    mp_mutex_lock(&r->lock);
+    while (r->num_queue >= RENDITION_QUEUE_SIZE)
+        mp_cond_wait(&r->wakeup, &r->lock);
+    MP_TARRAY_APPEND(r, r->queue, r->num_queue, mpi);
+    mp_cond_broadcast(&r->wakeup);
+    mp_mutex_unlock(&r->lock);
+}
+
+// Open the encoder and muxer for r, using the settings of the main encoder.
+static bool init_rendition(struct vo *vo, struct rendition *r,
+                           struct mp_image *img)
+{
+    struct priv *vc = vo->priv;
+    AVCodecContext *src_enc = vc->enc->encoder;
+
+    int d_w, d_h;
+    mp_image_params_get_dsize(&img->params, &d_w, &d_h);
+    if (!r->w)
+        r->w = MPMAX(2, (int)lrint((double)r->h * d_w / d_h) & ~1);
+    if (!r->h)
+        r->h = MPMAX(2, (int)lrint((double)r->w * d_h / d_w) & ~1);
+    r->imgfmt = img->imgfmt;
+
+    char *vopts[] = {"b", r->bitrate, NULL};
+    r->ectx = encode_lavc_init_rendition(vo->encode_lavc_ctx, r->file,
+                                         r->bitrate ? vopts : NULL);
+    if (!r->ectx)
+        return false;
+    r->enc = encoder_context_alloc(r->ectx, STREAM_VIDEO, r->log);
+    if (!r->enc)
+        return false;
+
+    AVCodecContext *encoder = r->enc->encoder;
+    // Keep the display aspect ratio of the source.
+    av_reduce(&encoder->sample_aspect_ratio.num,
+              &encoder->sample_aspect_ratio.den,
+              (int64_t)d_w * r->h, (int64_t)d_h * r->w, INT_MAX);
+    encoder->width = r->w;
+    encoder->height = r->h;
+    encoder->pix_fmt = src_enc->pix_fmt;
+    encoder->colorspace = src_enc->colorspace;
+    encoder->color_range = src_enc->color_range;
+    encoder->time_base = src_enc->time_base;
+    encoder->framerate = src_enc->framerate;
+
+    MP_INFO(r, "Encoding %dx%d to %s\n", r->w, r->h, r->file);
+    if (!encoder_init_codec_and_muxer(r->enc))
+        return false;
+
+    r->sws = mp_sws_alloc(r);
+    r->sws->log = r->log;
+    mp_sws_enable_cmdline_opts(r->sws, vo->global);
+
+    if (mp_thread_create(&r->thread, rendition_thread, r)) {
+        MP_ERR(r, "Failed to create encoder thread.\n");
+        return false;
+    }
+    r->thread_valid = true;
+    return true;
+}
+
+static void uninit_rendition(struct rendition *r)
+{
+    if (r->thread_valid) {
+        mp_mutex_lock(&r->lock);
+        r->terminate = true;
+        mp_cond_broadcast(&r->wakeup);
+        mp_mutex_unlock(&r->lock);
+        mp_thread_join(r->thread);
+    }
+    TA_FREEP(&r->enc);
+    if (r->ectx && !encode_lavc_free(r->ectx))
+        MP_ERR(r, "Encoding %s failed.\n", r->file);
+    r->ectx = NULL;
+    for (int n = 0; n < r->num_queue; n++)
+        talloc_free(r->queue[n]);
+    mp_cond_destroy(&r->wakeup);
+    mp_mutex_destroy(&r->lock);
+}
+
 static int preinit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
@@ -50,6 +246,21 @@ static int preinit(struct vo *vo)
     if (!vc->enc)
         return -1;
     talloc_steal(vc, vc->enc);
+
+    char **list = vc->enc->options->renditions;
+    for (int n = 0; list && list[n]; n++) {
+        struct rendition *r = talloc_ptrtype(vc, r);
+        *r = (struct rendition){
+            .log = mp_log_new(r, vo->log, "rendition"),
+        };
+        mp_mutex_init(&r->lock);
+        mp_cond_init(&r->wakeup);
+        MP_TARRAY_APPEND(vc, vc->renditions, vc->num_renditions, r);
+        if (!parse_rendition(r, list[n])) {
+            MP_FATAL(vo, "Invalid --orenditions entry: '%s'\n", list[n]);
+            return -1;
+        }
+    }
     return 0;
 }
 
@@ -60,6 +271,10 @@ static void uninit(struct vo *vo)
 
     if (!vc->shutdown)
         encoder_encode(enc, NULL); // finish encoding
+
+    for (int n = 0; n < vc->num_renditions; n++)
+        uninit_rendition(vc->renditions[n]);
+    vc->num_renditions = 0;
 }
 
 static int reconfig2(struct vo *vo, struct mp_image *img)
@@ -146,6 +361,11 @@ static int reconfig2(struct vo *vo, struct mp_image *img)
     if (!encoder_init_codec_and_muxer(vc->enc))
         goto error;
 
+    for (int n = 0; n < vc->num_renditions; n++) {
+        if (!init_rendition(vo, vc->renditions[n], img))
+            goto error;
+    }
+
     return 0;
 
 error:
@@ -226,6 +446,14 @@ static bool draw_frame(struct vo *vo, struct vo_frame *voframe)
 
     mp_mutex_unlock(&ectx->lock);
 
+    // Hand the frame to the renditions first, so they encode in parallel.
+    for (int n = 0; n < vc->num_renditions; n++) {
+        struct mp_image *ref = mp_image_new_ref(mpi);
+        MP_HANDLE_OOM(ref);
+        ref->pts = outpts;
+        queue_rendition_frame(vc->renditions[n], ref);
+    }
+
     AVFrame *frame = mp_image_to_av_frame(mpi);
     MP_HANDLE_OOM(frame);
 
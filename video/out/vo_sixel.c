@@ -28,6 +28,9 @@
 #include <sixel.h>
 
 #include "config.h"
+#include "common/stats.h"
+#include "misc/thread_pool.h"
+#include "misc/thread_tools.h"
 #include "options/m_config.h"
 #include "osdep/terminal.h"
 #include "sub/osd.h"
@@ -54,6 +57,17 @@ struct vo_sixel_opts {
     int rows, cols;
     bool config_clear, alt_screen;
     bool buffered;
+    bool pipeline;
+};
+
+// A frame handed to the encoder.
+struct sixel_job {
+    uint8_t *buffer;
+    sixel_dither_t *dither;  // own reference
+    int width, height;
+    int top, left;
+    struct mp_waiter waiter;
+    bool active;             // queued on the encoder thread
 };
 
 struct priv {
@@ -65,6 +79,7 @@ struct priv {
     sixel_dither_t *dither;
     sixel_dither_t *testdither;
     uint8_t        *buffer;
+    uint8_t        *encode_buffer;  // pipeline mode: being encoded or free
     char           *sixel_output_buf;
     bool            skip_frame_draw;
 
@@ -80,21 +95,48 @@ struct priv {
     struct mp_osd_res osd;
     struct mp_image *frame;
     struct mp_sws_context *sws;
+
+    struct stats_ctx *stats;
+    struct mp_thread_pool *encoder;  // pipeline mode only
+    struct sixel_job job;
 };
 
 static const unsigned int depth = 3;
 
+// Number of distinct colors in the image, with 5 bits per component and only
+// every other pixel and line sampled. This is much cheaper than libsixel's
+// histogram, and only used to decide whether a new palette is needed.
+static int count_colors(struct priv *priv)
+{
+    uint32_t seen[(1 << 15) / 32] = {0};
+    int colors = 0;
+    for (int y = 0; y < priv->height; y += 2) {
+        const uint8_t *line = priv->buffer + y * priv->width * depth;
+        for (int x = 0; x < priv->width; x += 2) {
+            const uint8_t *px = line + x * depth;
+            unsigned c = (px[0] >> 3) << 10 | (px[1] >> 3) << 5 | (px[2] >> 3);
+            uint32_t bit = 1u << (c & 31);
+            colors += !(seen[c >> 5] & bit);
+            seen[c >> 5] |= bit;
+        }
+    }
+    return colors;
+}
+
 static int detect_scene_change(struct vo* vo)
 {
     struct priv* priv = vo->priv;
     int previous_histogram_colors = priv->previous_histogram_colors;
-    int histogram_colors = 0;
 
     // If threshold is set negative, then every frame must be a scene change
-    if (priv->dither == NULL || priv->opts.threshold < 0)
+    if (priv->opts.threshold < 0)
         return 1;
 
-    histogram_colors = sixel_dither_get_num_of_histogram_colors(priv->testdither);
+    int histogram_colors = count_colors(priv);
+    if (priv->dither == NULL) {
+        priv->previous_histogram_colors = histogram_colors;
+        return 1;
+    }
 
     int color_difference_count = previous_histogram_colors - histogram_colors;
     color_difference_count = (color_difference_count > 0) ?  // abs value
@@ -111,14 +153,27 @@ static int detect_scene_change(struct vo* vo)
 
 }
 
+static void wait_encoder(struct vo *vo)
+{
+    struct priv *priv = vo->priv;
+
+    if (!priv->job.active)
+        return;
+
+    stats_time_start(priv->stats, "encode-wait");
+    mp_waiter_wait(&priv->job.waiter);
+    stats_time_end(priv->stats, "encode-wait");
+    priv->job.active = false;
+}
+
 static void dealloc_dithers_and_buffers(struct vo* vo)
 {
     struct priv* priv = vo->priv;
 
-    if (priv->buffer) {
-        talloc_free(priv->buffer);
-        priv->buffer = NULL;
-    }
+    wait_encoder(vo);
+
+    TA_FREEP(&priv->buffer);
+    TA_FREEP(&priv->encode_buffer);
 
     if (priv->frame) {
         talloc_free(priv->frame);
@@ -146,9 +201,9 @@ static SIXELSTATUS prepare_static_palette(struct vo* vo)
             return SIXEL_FALSE;
 
         sixel_dither_set_diffusion_type(priv->dither, priv->opts.diffuse);
+        sixel_dither_set_body_only(priv->dither, 0);
     }
 
-    sixel_dither_set_body_only(priv->dither, 0);
     return SIXEL_OK;
 }
 
@@ -157,6 +212,10 @@ static SIXELSTATUS prepare_dynamic_palette(struct vo *vo)
     SIXELSTATUS status = SIXEL_FALSE;
     struct priv *priv = vo->priv;
 
+    // Keep using the previous palette unless the scene changed.
+    if (!detect_scene_change(vo))
+        return priv->dither ? SIXEL_OK : SIXEL_FALSE;
+
     /* create histogram and construct color palette
      * with median cut algorithm. */
     status = sixel_dither_initialize(priv->testdither, priv->buffer,
@@ -167,24 +226,18 @@ static SIXELSTATUS prepare_dynamic_palette(struct vo *vo)
     if (SIXEL_FAILED(status))
         return status;
 
-    if (detect_scene_change(vo)) {
-        if (priv->dither) {
-            sixel_dither_unref(priv->dither);
-            priv->dither = NULL;
-        }
-
-        priv->dither = priv->testdither;
-        status = sixel_dither_new(&priv->testdither, priv->opts.reqcolors, NULL);
+    if (priv->dither) {
+        sixel_dither_unref(priv->dither);
+        priv->dither = NULL;
+    }
 
-        if (SIXEL_FAILED(status))
-            return status;
+    priv->dither = priv->testdither;
+    status = sixel_dither_new(&priv->testdither, priv->opts.reqcolors, NULL);
 
-        sixel_dither_set_diffusion_type(priv->dither, priv->opts.diffuse);
-    } else {
-        if (priv->dither == NULL)
-            return SIXEL_FALSE;
-    }
+    if (SIXEL_FAILED(status))
+        return status;
 
+    sixel_dither_set_diffusion_type(priv->dither, priv->opts.diffuse);
     sixel_dither_set_body_only(priv->dither, 0);
     return status;
 }
@@ -318,6 +371,10 @@ static int update_sixel_swscaler(struct vo *vo, struct mp_image_params *params)
 
     priv->buffer =
         talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
+    if (priv->opts.pipeline) {
+        priv->encode_buffer =
+            talloc_array(NULL, uint8_t, depth * priv->width * priv->height);
+    }
 
     return 0;
 }
@@ -365,6 +422,7 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
 {
     struct priv *priv = vo->priv;
     int ret = 0;
+    wait_encoder(vo);
     update_canvas_dimensions(vo);
     if (priv->canvas_ok) {  // if too small - succeed but skip the rendering
         set_sixel_output_parameters(vo);
@@ -415,6 +473,8 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
         priv->skip_frame_draw = false;
     }
 
+    stats_time_start(priv->stats, "scale");
+
     // Normal case where we have to draw the frame and the image is not NULL
     if (frame->current) {
         mpi = mp_image_new_ref(frame->current);
@@ -440,6 +500,9 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     memcpy_pic(priv->buffer, priv->frame->planes[0], priv->width * depth,
                priv->height, priv->width * depth, priv->frame->stride[0]);
 
+    stats_time_end(priv->stats, "scale");
+    stats_time_start(priv->stats, "palette");
+
     // Even if either of these prepare palette functions fail, on re-running them
     // they should try to re-initialize the dithers, so it shouldn't dereference
     // any NULL pointers. flip_page also has a check to make sure dither is not
@@ -450,6 +513,8 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
         status = prepare_dynamic_palette(vo);
     }
 
+    stats_time_end(priv->stats, "palette");
+
     if (SIXEL_FAILED(status)) {
         MP_WARN(vo, "draw_frame: prepare_palette returned error: %s\n",
                 sixel_helper_format_error(status));
@@ -462,6 +527,40 @@ done:
     return VO_TRUE;
 }
 
+static void encode_frame(struct vo *vo, struct sixel_job *job)
+{
+    struct priv *priv = vo->priv;
+
+    stats_time_start(priv->stats, "encode");
+
+    // Go to the offset row and column, then display the image
+    priv->sixel_output_buf = talloc_asprintf(NULL, TERM_ESC_GOTO_YX,
+                                             job->top, job->left);
+    if (!priv->opts.buffered)
+        sixel_strwrite(priv->sixel_output_buf);
+
+    sixel_encode(job->buffer, job->width, job->height,
+                 depth, job->dither, priv->output);
+
+    if (priv->opts.buffered)
+        sixel_write(priv->sixel_output_buf,
+                    ta_get_size(priv->sixel_output_buf), stdout);
+
+    talloc_free(priv->sixel_output_buf);
+
+    stats_time_end(priv->stats, "encode");
+}
+
+static void encode_thread(void *ptr)
+{
+    struct vo *vo = ptr;
+    struct priv *priv = vo->priv;
+
+    encode_frame(vo, &priv->job);
+    sixel_dither_unref(priv->job.dither);
+    mp_waiter_wakeup(&priv->job.waiter, 0);
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv* priv = vo->priv;
@@ -476,20 +575,30 @@ static void flip_page(struct vo *vo)
     if (priv->buffer == NULL || priv->dither == NULL)
         return;
 
-    // Go to the offset row and column, then display the image
-    priv->sixel_output_buf = talloc_asprintf(NULL, TERM_ESC_GOTO_YX,
-                                             priv->top, priv->left);
-    if (!priv->opts.buffered)
-        sixel_strwrite(priv->sixel_output_buf);
-
-    sixel_encode(priv->buffer, priv->width, priv->height,
-                 depth, priv->dither, priv->output);
+    // The previous frame must be on the terminal before this one is written,
+    // and its buffer becomes the next scaling target.
+    wait_encoder(vo);
+
+    priv->job = (struct sixel_job){
+        .buffer = priv->buffer,
+        .dither = priv->dither,
+        .width = priv->width,
+        .height = priv->height,
+        .top = priv->top,
+        .left = priv->left,
+    };
 
-    if (priv->opts.buffered)
-        sixel_write(priv->sixel_output_buf,
-                    ta_get_size(priv->sixel_output_buf), stdout);
+    if (!priv->encoder) {
+        encode_frame(vo, &priv->job);
+        return;
+    }
 
-    talloc_free(priv->sixel_output_buf);
+    // Encode this frame while the next one is scaled into the other buffer.
+    sixel_dither_ref(priv->job.dither);
+    priv->job.waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+    priv->job.active = true;
+    mp_thread_pool_queue(priv->encoder, encode_thread, vo);
+    MPSWAP(uint8_t *, priv->buffer, priv->encode_buffer);
 }
 
 static int preinit(struct vo *vo)
@@ -497,6 +606,8 @@ static int preinit(struct vo *vo)
     struct priv *priv = vo->priv;
     SIXELSTATUS status = SIXEL_FALSE;
 
+    priv->stats = stats_ctx_create(priv, vo->global, "vo-sixel");
+
     // Parse opts set by CLI or conf
     priv->sws = mp_sws_alloc(vo);
     priv->sws->log = vo->log;
@@ -538,6 +649,14 @@ static int preinit(struct vo *vo)
 
     priv->previous_histogram_colors = 0;
 
+    if (priv->opts.pipeline) {
+        priv->encoder = mp_thread_pool_create(priv, 1, 1, 1);
+        if (!priv->encoder) {
+            MP_ERR(vo, "preinit: Failed to create encoder thread\n");
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -558,6 +677,9 @@ static void uninit(struct vo *vo)
 {
     struct priv *priv = vo->priv;
 
+    wait_encoder(vo);
+    TA_FREEP(&priv->encoder);
+
     sixel_strwrite(TERM_ESC_RESTORE_CURSOR);
     terminal_set_mouse_input(false);
 
@@ -621,6 +743,7 @@ const struct vo_driver video_out_sixel = {
         {"config-clear", OPT_BOOL(opts.config_clear), },
         {"alt-screen", OPT_BOOL(opts.alt_screen), },
         {"buffered", OPT_BOOL(opts.buffered), },
+        {"pipeline", OPT_BOOL(opts.pipeline), },
         {0}
     },
     .options_prefix = "vo-sixel",
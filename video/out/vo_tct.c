@@ -24,6 +24,7 @@
 
 #include <libswscale/swscale.h>
 
+#include "common/stats.h"
 #include "options/m_config.h"
 #include "config.h"
 #include "osdep/terminal.h"
@@ -41,6 +42,10 @@
 #define DEFAULT_WIDTH 80
 #define DEFAULT_HEIGHT 25
 
+// Unchanged cells between two changed ones are rewritten instead of skipped
+// with a cursor move if there are at most this many of them.
+#define MAX_REWRITE_GAP 2
+
 static const bstr TERM_ESC_COLOR256_BG     = bstr0_lit("\033[48;5");
 static const bstr TERM_ESC_COLOR256_FG     = bstr0_lit("\033[38;5");
 static const bstr TERM_ESC_COLOR24BIT_BG   = bstr0_lit("\033[48;2");
@@ -48,6 +53,10 @@ static const bstr TERM_ESC_COLOR24BIT_FG   = bstr0_lit("\033[38;2");
 
 static const bstr UNICODE_LOWER_HALF_BLOCK = bstr0_lit("\xe2\x96\x84");
 
+// Worst case output for a single cell: cursor move, both colors, glyph.
+#define MAX_GOTO_BYTES 16
+#define MAX_CELL_BYTES (MAX_GOTO_BYTES + 2 * (6 + 3 * 4 + 1) + 3)
+
 #define WRITE_STR(str) fwrite((str), strlen(str), 1, stdout)
 
 enum vo_tct_buffering {
@@ -69,6 +78,12 @@ struct lut_item {
     uint8_t width;
 };
 
+// Colors of a terminal cell: xterm-256 index or 0xRRGGBB. fg is unused (0)
+// with ALGO_PLAIN.
+struct cell {
+    uint32_t bg, fg;
+};
+
 struct priv {
     struct vo_tct_opts opts;
     size_t buffer_size;
@@ -78,26 +93,49 @@ struct priv {
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_sws_context *sws;
-    bstr frame_buf;
     struct lut_item lut[256];
+    uint8_t x256_ci[256];   // channel value -> nearest xterm-256 cube index
+    uint8_t x256_gray[766]; // r + g + b -> nearest xterm-256 gray index
+
+    // Output buffer, large enough for a full frame in the worst case.
+    char *buf;
+    char *pos;
+    struct stats_ctx *stats;
+
+    // Cells as they were last written to the terminal (swidth * rows).
+    struct cell *cells;
+    int rows;
+    bool cells_valid;
+    uint32_t *line_colors[2]; // current row, bg/fg (swidth each)
+
+    // Tracked terminal state while writing a frame. -1/false means unknown.
+    int cur_row, cur_col;
+    struct cell cur_sgr;
+    bool sgr_valid;
+    size_t frame_bytes;
 };
 
+static void init_x256_lut(struct priv *p)
+{
+    for (int v = 0; v < 256; v++)
+        p->x256_ci[v] = v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+    for (int sum = 0; sum < 766; sum++) {
+        int average = sum / 3;
+        p->x256_gray[sum] = average > 238 ? 23 : (average - 3) / 10;
+    }
+}
+
 // Convert RGB24 to xterm-256 8-bit value
 // For simplicity, assume RGB space is perceptually uniform.
 // There are 5 places where one of two outputs needs to be chosen when the
 // input is the exact middle:
 // - The r/g/b channels and the gray value: the higher value output is chosen.
 // - If the gray and color have same distance from the input - color is chosen.
-static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
+static int rgb_to_x256(struct priv *p, uint8_t r, uint8_t g, uint8_t b)
 {
-    // Calculate the nearest 0-based color index at 16 .. 231
-#   define v2ci(v) (v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40)
-    int ir = v2ci(r), ig = v2ci(g), ib = v2ci(b);   // 0..5 each
-#   define color_index() (36 * ir + 6 * ig + ib)  /* 0..215, lazy evaluation */
-
-    // Calculate the nearest 0-based gray index at 232 .. 255
-    int average = (r + g + b) / 3;
-    int gray_index = average > 238 ? 23 : (average - 3) / 10;  // 0..23
+    // Nearest 0-based color index at 16 .. 231, and gray index at 232 .. 255
+    int ir = p->x256_ci[r], ig = p->x256_ci[g], ib = p->x256_ci[b];
+    int gray_index = p->x256_gray[r + g + b];
 
     // Calculate the represented colors back from the index
     static const int i2cv[6] = {0, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
@@ -108,98 +146,172 @@ static int rgb_to_x256(uint8_t r, uint8_t g, uint8_t b)
 #   define dist_square(A,B,C, a,b,c) ((A-a)*(A-a) + (B-b)*(B-b) + (C-c)*(C-c))
     int color_err = dist_square(cr, cg, cb, r, g, b);
     int gray_err  = dist_square(gv, gv, gv, r, g, b);
-    return color_err <= gray_err ? 16 + color_index() : 232 + gray_index;
+    return color_err <= gray_err ? 16 + 36 * ir + 6 * ig + ib : 232 + gray_index;
 }
 
-static void print_seq3(bstr *frame, struct lut_item *lut, bstr prefix,
-                       uint8_t r, uint8_t g, uint8_t b)
+static char *put_bstr(char *dst, bstr s)
 {
-    bstr_xappend(NULL, frame, prefix);
-    bstr_xappend(NULL, frame, (bstr){ lut[r].str, lut[r].width });
-    bstr_xappend(NULL, frame, (bstr){ lut[g].str, lut[g].width });
-    bstr_xappend(NULL, frame, (bstr){ lut[b].str, lut[b].width });
-    bstr_xappend0(NULL, frame, "m");
+    memcpy(dst, s.start, s.len);
+    return dst + s.len;
 }
 
-static void print_seq1(bstr *frame, struct lut_item *lut, bstr prefix, uint8_t c)
+static char *put_uint(char *dst, unsigned v)
 {
-    bstr_xappend(NULL, frame, prefix);
-    bstr_xappend(NULL, frame, (bstr){ lut[c].str, lut[c].width });
-    bstr_xappend0(NULL, frame, "m");
+    char tmp[12];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n)
+        *dst++ = tmp[--n];
+    return dst;
 }
 
-static void print_buffer(bstr *frame)
+// Same as TERM_ESC_GOTO_YX.
+static char *put_goto(char *dst, int row, int col)
 {
-    fwrite(frame->start, frame->len, 1, stdout);
-    frame->len = 0;
+    dst = put_bstr(dst, bstr0("\033["));
+    dst = put_uint(dst, row);
+    *dst++ = ';';
+    dst = put_uint(dst, col);
+    *dst++ = 'f';
+    return dst;
 }
 
-static void write_plain(bstr *frame,
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    const unsigned char *source, const int source_stride,
-    bool term256, struct lut_item *lut, enum vo_tct_buffering buffering)
+static char *put_lut(char *dst, const struct lut_item *item)
 {
-    mp_assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight; y++) {
-        const unsigned char *row = source + y * source_stride;
-        bstr_xappend_asprintf(NULL, frame, TERM_ESC_GOTO_YX, ty + y, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b = *row++;
-            unsigned char g = *row++;
-            unsigned char r = *row++;
-            if (term256) {
-                print_seq1(frame, lut, TERM_ESC_COLOR256_BG, rgb_to_x256(r, g, b));
-            } else {
-                print_seq3(frame, lut, TERM_ESC_COLOR24BIT_BG, r, g, b);
-            }
-            bstr_xappend0(NULL, frame, " ");
-            if (buffering <= VO_TCT_BUFFER_PIXEL)
-                print_buffer(frame);
+    memcpy(dst, item->str, sizeof(item->str));
+    return dst + item->width;
+}
+
+static char *put_color(struct priv *p, char *dst, bool bg, uint32_t c)
+{
+    if (p->opts.term256) {
+        dst = put_bstr(dst, bg ? TERM_ESC_COLOR256_BG : TERM_ESC_COLOR256_FG);
+        dst = put_lut(dst, &p->lut[c]);
+    } else {
+        dst = put_bstr(dst, bg ? TERM_ESC_COLOR24BIT_BG : TERM_ESC_COLOR24BIT_FG);
+        dst = put_lut(dst, &p->lut[c >> 16]);
+        dst = put_lut(dst, &p->lut[(c >> 8) & 0xFF]);
+        dst = put_lut(dst, &p->lut[c & 0xFF]);
+    }
+    *dst++ = 'm';
+    return dst;
+}
+
+static void print_buffer(struct priv *p)
+{
+    size_t len = p->pos - p->buf;
+    fwrite(p->buf, len, 1, stdout);
+    p->frame_bytes += len;
+    p->pos = p->buf;
+}
+
+// Convert a line of BGR24 pixels to cell colors.
+static void convert_line(struct priv *p, uint32_t *dst,
+                         const unsigned char *src, int w)
+{
+    uint32_t last_rgb = -1, last_c = 0; // never matches the first pixel
+    for (int x = 0; x < w; x++) {
+        const unsigned char *bgr = src + x * 3;
+        uint32_t rgb = ((uint32_t)bgr[2] << 16) | (bgr[1] << 8) | bgr[0];
+        if (rgb != last_rgb) {
+            last_rgb = rgb;
+            last_c = p->opts.term256 ? rgb_to_x256(p, bgr[2], bgr[1], bgr[0])
+                                     : rgb;
         }
-        bstr_xappend0(NULL, frame, TERM_ESC_CLEAR_COLORS);
-        if (buffering <= VO_TCT_BUFFER_LINE)
-            print_buffer(frame);
+        dst[x] = last_c;
     }
 }
 
-static void write_half_blocks(bstr *frame,
-    const int dwidth, const int dheight,
-    const int swidth, const int sheight,
-    unsigned char *source, int source_stride,
-    bool term256, struct lut_item *lut, enum vo_tct_buffering buffering)
+static bool cell_equal(struct cell a, struct cell b)
+{
+    return a.bg == b.bg && a.fg == b.fg;
+}
+
+// Write a single cell at the given terminal position, moving the cursor and
+// changing the colors only if needed.
+static void write_cell(struct priv *p, int row, int col, struct cell c)
+{
+    bool half_blocks = p->opts.algo == ALGO_HALF_BLOCKS;
+    char *dst = p->pos;
+
+    if (p->cur_row != row || p->cur_col != col)
+        dst = put_goto(dst, row, col);
+    if (!p->sgr_valid || c.bg != p->cur_sgr.bg)
+        dst = put_color(p, dst, true, c.bg);
+    if (half_blocks && (!p->sgr_valid || c.fg != p->cur_sgr.fg))
+        dst = put_color(p, dst, false, c.fg);
+    dst = put_bstr(dst, half_blocks ? UNICODE_LOWER_HALF_BLOCK : bstr0(" "));
+    p->pos = dst;
+
+    p->cur_row = row;
+    p->cur_col = col + 1;
+    p->cur_sgr = c;
+    p->sgr_valid = true;
+
+    if (p->opts.buffering <= VO_TCT_BUFFER_PIXEL)
+        print_buffer(p);
+}
+
+// Nothing else is written to the terminal while a frame is buffered, but
+// other output may happen between flushes.
+static void reset_state(struct priv *p)
+{
+    if (p->sgr_valid)
+        p->pos = put_bstr(p->pos, bstr0(TERM_ESC_CLEAR_COLORS));
+    print_buffer(p);
+    p->cur_row = p->cur_col = -1;
+    p->sgr_valid = false;
+}
+
+static void write_frame(struct priv *p, const int dwidth, const int dheight,
+                        const unsigned char *source, const int source_stride)
 {
     mp_assert(source);
-    const int tx = (dwidth - swidth) / 2;
-    const int ty = (dheight - sheight) / 2;
-    for (int y = 0; y < sheight * 2; y += 2) {
-        const unsigned char *row_up = source + y * source_stride;
-        const unsigned char *row_down = source + (y + 1) * source_stride;
-        bstr_xappend_asprintf(NULL, frame, TERM_ESC_GOTO_YX, ty + y / 2, tx);
-        for (int x = 0; x < swidth; x++) {
-            unsigned char b_up = *row_up++;
-            unsigned char g_up = *row_up++;
-            unsigned char r_up = *row_up++;
-            unsigned char b_down = *row_down++;
-            unsigned char g_down = *row_down++;
-            unsigned char r_down = *row_down++;
-            if (term256) {
-                print_seq1(frame, lut, TERM_ESC_COLOR256_BG, rgb_to_x256(r_up, g_up, b_up));
-                print_seq1(frame, lut, TERM_ESC_COLOR256_FG, rgb_to_x256(r_down, g_down, b_down));
-            } else {
-                print_seq3(frame, lut, TERM_ESC_COLOR24BIT_BG, r_up, g_up, b_up);
-                print_seq3(frame, lut, TERM_ESC_COLOR24BIT_FG, r_down, g_down, b_down);
+    bool half_blocks = p->opts.algo == ALGO_HALF_BLOCKS;
+    const int tx = MPMAX((dwidth - p->swidth) / 2, 1);
+    const int ty = (dheight - p->sheight) / 2;
+    uint32_t *bg = p->line_colors[0], *fg = p->line_colors[1];
+    for (int y = 0; y < p->rows; y++) {
+        // Terminal rows are 1-based; a row at 0 would be overdrawn by row 1.
+        if (ty + y < 1)
+            continue;
+        const int line = half_blocks ? y * 2 : y;
+        const unsigned char *row_up = source + line * source_stride;
+        convert_line(p, bg, row_up, p->swidth);
+        if (half_blocks)
+            convert_line(p, fg, row_up + source_stride, p->swidth);
+
+        struct cell *cells = p->cells + y * p->swidth;
+        int last = -1; // last written cell in this row
+        for (int x = 0; x < p->swidth; x++) {
+            struct cell c = { .bg = bg[x], .fg = half_blocks ? fg[x] : 0 };
+            if (p->cells_valid && cell_equal(cells[x], c))
+                continue;
+            cells[x] = c;
+            if (last >= 0 && x - last - 1 <= MAX_REWRITE_GAP) {
+                for (int n = last + 1; n < x; n++)
+                    write_cell(p, ty + y, tx + n, cells[n]);
             }
-            bstr_xappend(NULL, frame, UNICODE_LOWER_HALF_BLOCK);
-            if (buffering <= VO_TCT_BUFFER_PIXEL)
-                print_buffer(frame);
+            write_cell(p, ty + y, tx + x, c);
+            last = x;
         }
-        bstr_xappend0(NULL, frame, TERM_ESC_CLEAR_COLORS);
-        if (buffering <= VO_TCT_BUFFER_LINE)
-            print_buffer(frame);
+        if (p->opts.buffering <= VO_TCT_BUFFER_LINE)
+            reset_state(p);
     }
+    p->cells_valid = true;
+
+    // Leave the cursor below the image, where the terminal status line goes.
+    const int last_row = MPMAX(ty + p->rows - 1, 1);
+    if (p->cur_row != last_row)
+        p->pos = put_goto(p->pos, last_row, tx);
+    if (p->sgr_valid)
+        p->pos = put_bstr(p->pos, bstr0(TERM_ESC_CLEAR_COLORS));
+    *p->pos++ = '\n';
+    p->cur_row = p->cur_col = -1;
+    p->sgr_valid = false;
 }
 
 static void get_win_size(struct vo *vo, int *out_width, int *out_height) {
@@ -242,6 +354,19 @@ static int reconfig(struct vo *vo, struct mp_image_params *params)
     if (!p->frame)
         return -1;
 
+    p->rows = p->sheight;
+    p->cells = talloc_realloc(p, p->cells, struct cell, p->swidth * p->rows);
+    for (int n = 0; n < 2; n++)
+        p->line_colors[n] = talloc_realloc(p, p->line_colors[n], uint32_t, p->swidth);
+    p->cells_valid = false;
+
+    // Every cell may need a cursor move and both colors; plus the color reset
+    // per row, and the final cursor move, reset and newline.
+    size_t row_bytes = (size_t)p->swidth * MAX_CELL_BYTES + 8;
+    p->buf = talloc_realloc_size(p, p->buf,
+                                 row_bytes * p->rows + MAX_GOTO_BYTES + 8);
+    p->pos = p->buf;
+
     mp_image_clear(p->frame, 0, 0, p->frame->w, p->frame->h);
 
     if (mp_sws_reinit(p->sws) < 0)
@@ -261,6 +386,9 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
         goto done;
     // XXX: pan, crop etc.
     mp_sws_scale(p->sws, p->frame, src);
+    // Explicit redraws rewrite everything, in case the terminal got garbled.
+    if (frame->redraw)
+        p->cells_valid = false;
 
 done:
     return VO_TRUE;
@@ -278,22 +406,15 @@ static void flip_page(struct vo *vo)
 
     WRITE_STR(TERM_ESC_SYNC_UPDATE_BEGIN);
 
-    p->frame_buf.len = 0;
-    if (p->opts.algo == ALGO_PLAIN) {
-        write_plain(&p->frame_buf,
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts.term256, p->lut, p->opts.buffering);
-    } else {
-        write_half_blocks(&p->frame_buf,
-            vo->dwidth, vo->dheight, p->swidth, p->sheight,
-            p->frame->planes[0], p->frame->stride[0],
-            p->opts.term256, p->lut, p->opts.buffering);
-    }
+    p->pos = p->buf;
+    p->frame_bytes = 0;
+    p->cur_row = p->cur_col = -1;
+    p->sgr_valid = false;
+    write_frame(p, vo->dwidth, vo->dheight,
+                p->frame->planes[0], p->frame->stride[0]);
+    print_buffer(p);
 
-    bstr_xappend0(NULL, &p->frame_buf, "\n");
-    if (p->opts.buffering <= VO_TCT_BUFFER_FRAME)
-        print_buffer(&p->frame_buf);
+    stats_value(p->stats, "bytes-per-frame", p->frame_bytes);
 
     WRITE_STR(TERM_ESC_SYNC_UPDATE_END);
     fflush(stdout);
@@ -306,7 +427,6 @@ static void uninit(struct vo *vo)
     WRITE_STR(TERM_ESC_NORMAL_SCREEN);
     struct priv *p = vo->priv;
     talloc_free(p->frame);
-    talloc_free(p->frame_buf.start);
 }
 
 static int preinit(struct vo *vo)
@@ -316,6 +436,7 @@ static int preinit(struct vo *vo)
     vo->monitor_par = vo->opts->monitor_pixel_aspect * 2;
 
     struct priv *p = vo->priv;
+    p->stats = stats_ctx_create(p, vo->global, "vo-tct");
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
@@ -330,6 +451,7 @@ static int preinit(struct vo *vo)
         *out++ = '0' + (i % 10);
         p->lut[i].width = out - p->lut[i].str;
     }
+    init_x256_lut(p);
 
     WRITE_STR(TERM_ESC_HIDE_CURSOR);
     terminal_set_mouse_input(true);
@@ -23,6 +23,7 @@
 
 #include "osdep/endian.h"
 #include "present_sync.h"
+#include "sub/draw_bmp.h"
 #include "sub/osd.h"
 #include "video/fmt-conversion.h"
 #include "video/mp_image.h"
@@ -32,6 +33,10 @@
 
 #define IMGFMT_WL_RGB MP_SELECT_LE_BE(IMGFMT_BGR0, IMGFMT_0RGB)
 
+// Number of frames for which damage is remembered. Buffers which were last
+// drawn longer ago than this are redrawn completely.
+#define DAMAGE_HISTORY 8
+
 struct buffer {
     struct vo *vo;
     size_t size;
@@ -39,6 +44,8 @@ struct buffer {
     struct wl_buffer *buffer;
     struct mp_image mpi;
     struct buffer *next;
+    uint64_t geometry_id;   // priv.geometry_id at the time it was drawn
+    uint64_t frame_count;   // priv.frame_count at the time it was drawn
 };
 
 struct priv {
@@ -47,6 +54,21 @@ struct priv {
     struct mp_rect src;
     struct mp_rect dst;
     struct mp_osd_res osd;
+    struct mp_draw_sub_cache *osd_cache;
+
+    // Incremented whenever the contents of all buffers become invalid.
+    uint64_t geometry_id;
+    // Number of drawn frames, and the region that changed with each of the
+    // last ones (relative to the previous frame).
+    uint64_t frame_count;
+    struct mp_rect damage[DAMAGE_HISTORY];
+    struct mp_rect frame_damage;
+
+    // What the last drawn frame contained.
+    uint64_t last_geometry_id;
+    uint64_t last_video_id;
+    int64_t last_osd_change_id;
+    struct mp_rect last_osd_rc;
 };
 
 static void buffer_handle_release(void *data, struct wl_buffer *wl_buffer)
@@ -155,6 +177,7 @@ static int preinit(struct vo *vo)
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
+    p->osd_cache = mp_draw_sub_alloc(p, vo->global);
 
     return 0;
 err:
@@ -193,6 +216,7 @@ static int resize(struct vo *vo)
 
     vo_wayland_set_opaque_region(wl, false);
     vo->want_redraw = true;
+    p->geometry_id++;
     vo->dwidth = width;
     vo->dheight = height;
     vo_get_src_dst_rects(vo, &p->src, &p->dst, &p->osd);
@@ -239,6 +263,41 @@ static int control(struct vo *vo, uint32_t request, void *data)
     return ret;
 }
 
+// Like mp_rect_union(), but handles empty rectangles.
+static void add_rect(struct mp_rect *rc, struct mp_rect add)
+{
+    if (add.x1 <= add.x0 || add.y1 <= add.y0)
+        return;
+    if (rc->x1 <= rc->x0 || rc->y1 <= rc->y0) {
+        *rc = add;
+    } else {
+        mp_rect_union(rc, &add);
+    }
+}
+
+static bool rect_overlaps(struct mp_rect a, struct mp_rect b)
+{
+    return mp_rect_intersection(&a, &b);
+}
+
+static struct mp_rect osd_bounds(struct sub_bitmap_list *list,
+                                 struct mp_rect clip)
+{
+    struct mp_rect rc = {0};
+    for (int n = 0; n < list->num_items; n++) {
+        struct sub_bitmaps *sb = list->items[n];
+        for (int i = 0; i < sb->num_parts; i++) {
+            struct sub_bitmap *part = &sb->parts[i];
+            add_rect(&rc, (struct mp_rect){part->x, part->y,
+                                           part->x + part->dw,
+                                           part->y + part->dh});
+        }
+    }
+    if (!mp_rect_intersection(&rc, &clip))
+        rc = (struct mp_rect){0};
+    return rc;
+}
+
 static bool draw_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct priv *p = vo->priv;
@@ -250,6 +309,8 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
     if (!render)
         return VO_FALSE;
 
+    p->frame_damage = (struct mp_rect){0, 0, vo->dwidth, vo->dheight};
+
     buf = p->free_buffers;
     if (buf) {
         p->free_buffers = buf->next;
@@ -260,35 +321,101 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
             goto done;
         }
     }
+
+    struct mp_rect full = {0, 0, buf->mpi.w, buf->mpi.h};
+    struct mp_rect src_rc;
+    struct mp_rect dst_rc = full;
     if (src) {
-        vo_wayland_handle_color(wl);
-        struct mp_image dst = buf->mpi;
-        struct mp_rect src_rc;
-        struct mp_rect dst_rc;
         src_rc.x0 = MP_ALIGN_DOWN(p->src.x0, src->fmt.align_x);
         src_rc.y0 = MP_ALIGN_DOWN(p->src.y0, src->fmt.align_y);
         src_rc.x1 = p->src.x1 - (p->src.x0 - src_rc.x0);
         src_rc.y1 = p->src.y1 - (p->src.y0 - src_rc.y0);
-        dst_rc.x0 = MP_ALIGN_DOWN(p->dst.x0, dst.fmt.align_x);
-        dst_rc.y0 = MP_ALIGN_DOWN(p->dst.y0, dst.fmt.align_y);
+        dst_rc.x0 = MP_ALIGN_DOWN(p->dst.x0, buf->mpi.fmt.align_x);
+        dst_rc.y0 = MP_ALIGN_DOWN(p->dst.y0, buf->mpi.fmt.align_y);
         dst_rc.x1 = p->dst.x1 - (p->dst.x0 - dst_rc.x0);
         dst_rc.y1 = p->dst.y1 - (p->dst.y0 - dst_rc.y0);
-        mp_image_crop_rc(src, src_rc);
-        mp_image_crop_rc(&dst, dst_rc);
-        mp_sws_scale(p->sws, &dst, src);
-        if (dst_rc.y0 > 0)
-            mp_image_clear(&buf->mpi, 0, 0, buf->mpi.w, dst_rc.y0);
-        if (buf->mpi.h > dst_rc.y1)
-            mp_image_clear(&buf->mpi, 0, dst_rc.y1, buf->mpi.w, buf->mpi.h);
-        if (dst_rc.x0 > 0)
-            mp_image_clear(&buf->mpi, 0, dst_rc.y0, dst_rc.x0, dst_rc.y1);
-        if (buf->mpi.w > dst_rc.x1)
-            mp_image_clear(&buf->mpi, dst_rc.x1, dst_rc.y0, buf->mpi.w, dst_rc.y1);
-        osd_draw_on_image(vo->osd, p->osd, src->pts, 0, &buf->mpi);
+    }
+    uint64_t video_id = src ? frame->frame_id : 0;
+    if (src)
+        vo_wayland_handle_color(wl);
+
+    struct sub_bitmap_list *osd_list =
+        osd_render(vo->osd, p->osd, src ? src->pts : 0, 0, mp_draw_sub_formats);
+    struct mp_rect osd_rc = osd_bounds(osd_list, full);
+
+    // Region that changed since the previous frame.
+    struct mp_rect damage = {0};
+    if (p->last_geometry_id != p->geometry_id || !p->frame_count) {
+        damage = full;
     } else {
-        mp_image_clear(&buf->mpi, 0, 0, buf->mpi.w, buf->mpi.h);
-        osd_draw_on_image(vo->osd, p->osd, 0, 0, &buf->mpi);
+        if (video_id != p->last_video_id)
+            add_rect(&damage, dst_rc);
+        if (osd_list->change_id != p->last_osd_change_id) {
+            add_rect(&damage, p->last_osd_rc);
+            add_rect(&damage, osd_rc);
+        }
+    }
+    p->frame_count++;
+    p->damage[p->frame_count % DAMAGE_HISTORY] = damage;
+    p->frame_damage = damage;
+    p->last_geometry_id = p->geometry_id;
+    p->last_video_id = video_id;
+    p->last_osd_change_id = osd_list->change_id;
+    p->last_osd_rc = osd_rc;
+
+    // Region that changed since this buffer was drawn.
+    struct mp_rect redraw = {0};
+    uint64_t age = p->frame_count - buf->frame_count;
+    if (buf->geometry_id != p->geometry_id || !buf->frame_count ||
+        age >= DAMAGE_HISTORY)
+    {
+        redraw = full;
+    } else {
+        for (uint64_t n = buf->frame_count + 1; n <= p->frame_count; n++)
+            add_rect(&redraw, p->damage[n % DAMAGE_HISTORY]);
+    }
+    buf->geometry_id = p->geometry_id;
+    buf->frame_count = p->frame_count;
+
+    if (mp_rect_w(redraw) > 0 && mp_rect_h(redraw) > 0) {
+        // The video can only be redrawn as a whole, and the OSD is blended,
+        // so everything it covers must be restored first.
+        if (osd_list->num_items)
+            add_rect(&redraw, osd_rc);
+        bool draw_video = rect_overlaps(redraw, dst_rc);
+        if (draw_video)
+            add_rect(&redraw, dst_rc);
+
+        struct mp_rect clear[4];
+        int num_clear = mp_rect_subtract(&redraw, &dst_rc, clear);
+        if (!draw_video) {
+            clear[0] = redraw;
+            num_clear = 1;
+        }
+        for (int n = 0; n < num_clear; n++) {
+            mp_image_clear(&buf->mpi, clear[n].x0, clear[n].y0,
+                           clear[n].x1, clear[n].y1);
+        }
+
+        if (draw_video) {
+            if (src) {
+                struct mp_image src_crop = *src;
+                struct mp_image dst = buf->mpi;
+                mp_image_crop_rc(&src_crop, src_rc);
+                mp_image_crop_rc(&dst, dst_rc);
+                mp_sws_scale(p->sws, &dst, &src_crop);
+            } else {
+                mp_image_clear(&buf->mpi, 0, 0, buf->mpi.w, buf->mpi.h);
+            }
+        }
+
+        if (osd_list->num_items) {
+            if (!mp_draw_sub_bitmaps(p->osd_cache, &buf->mpi, osd_list))
+                MP_WARN(vo, "Failed rendering OSD.\n");
+        }
     }
+    talloc_free(osd_list);
+
     wl_surface_attach(wl->surface, buf->buffer, 0, 0);
 
 done:
@@ -297,10 +424,15 @@ done:
 
 static void flip_page(struct vo *vo)
 {
+    struct priv *p = vo->priv;
     struct vo_wayland_state *wl = vo->wl;
+    struct mp_rect rc = p->frame_damage;
 
-    wl_surface_damage_buffer(wl->surface, 0, 0, vo->dwidth,
-                             vo->dheight);
+    // Always damage something, so the compositor doesn't skip the commit.
+    if (mp_rect_w(rc) <= 0 || mp_rect_h(rc) <= 0)
+        rc = (struct mp_rect){0, 0, 1, 1};
+    wl_surface_damage_buffer(wl->surface, rc.x0, rc.y0, mp_rect_w(rc),
+                             mp_rect_h(rc));
     wl_surface_commit(wl->surface);
 
     if (wl->opts->wl_internal_vsync)
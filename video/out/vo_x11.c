@@ -51,13 +51,17 @@
 #include "options/options.h"
 #include "osdep/timer.h"
 
+// One buffer per in-flight frame, plus the one being rendered.
+#define MAX_BUFFERS (VO_MAX_SWAPCHAIN_DEPTH + 1)
+
 struct priv {
     struct vo *vo;
 
     struct mp_image *original_image;
 
-    XImage *myximage[2];
-    struct mp_image mp_ximages[2];
+    int num_buffers;
+    XImage *myximage[MAX_BUFFERS];
+    struct mp_image mp_ximages[MAX_BUFFERS];
     int depth;
     GC gc;
 
@@ -75,11 +79,18 @@ struct priv {
     int current_buf;
 
     int Shmem_Flag;
-    XShmSegmentInfo Shminfo[2];
+    XShmSegmentInfo Shminfo[MAX_BUFFERS];
     int Shm_Warned_Slow;
+
+    // Number of XShmPutImage calls so far, and the value it had when each
+    // buffer was last put. Completions arrive in request order, so a buffer
+    // is still in use if it was one of the last ShmCompletionWaitCount puts.
+    uint64_t put_count;
+    uint64_t put_seq[MAX_BUFFERS];
 };
 
 static bool resize(struct vo *vo);
+static void wait_for_completion(struct vo *vo, int max_outstanding);
 
 static bool getMyXImage(struct priv *p, int foo)
 {
@@ -162,6 +173,7 @@ static void freeMyXImage(struct priv *p, int foo)
         }
     }
     p->myximage[foo] = NULL;
+    p->put_seq[foo] = 0;
 }
 
 #define MAKE_MASK(comp) (((1ul << (comp).size) - 1) << (comp).offset)
@@ -186,13 +198,15 @@ static bool resize(struct vo *vo)
     int nh = MPMAX(1, vo->dheight);
 
     if (nw > p->image_width || nh > p->image_height) {
-        for (int i = 0; i < 2; i++)
+        // The X server may still be reading from the segments.
+        wait_for_completion(vo, 0);
+        for (int i = 0; i < p->num_buffers; i++)
             freeMyXImage(p, i);
 
         p->image_width = nw;
         p->image_height = nh;
 
-        for (int i = 0; i < 2; i++) {
+        for (int i = 0; i < p->num_buffers; i++) {
             if (!getMyXImage(p, i)) {
                 p->image_width = 0;
                 p->image_height = 0;
@@ -242,7 +256,7 @@ static bool resize(struct vo *vo)
     }
     MP_VERBOSE(vo, "Using mp format: %s\n", mp_imgfmt_to_name(mpfmt));
 
-    for (int i = 0; i < 2; i++) {
+    for (int i = 0; i < p->num_buffers; i++) {
         struct mp_image *img = &p->mp_ximages[i];
         *img = (struct mp_image){0};
         mp_image_setfmt(img, mpfmt);
@@ -286,6 +300,7 @@ static void Display_Image(struct priv *p, XImage *myximage)
         XShmPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
                      0, 0, 0, 0, vo->dwidth, vo->dheight, True);
         vo->x11->ShmCompletionWaitCount++;
+        p->put_seq[p->current_buf] = ++p->put_count;
     } else {
         XPutImage(vo->x11->display, vo->x11->window, p->gc, x_image,
                   0, 0, 0, 0, vo->dwidth, vo->dheight);
@@ -309,11 +324,35 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
     }
 }
 
+static bool buffer_busy(struct vo *vo, int buf)
+{
+    struct priv *p = vo->priv;
+    uint64_t completed = p->put_count - vo->x11->ShmCompletionWaitCount;
+    return p->Shmem_Flag && p->put_seq[buf] > completed;
+}
+
+// Pick a buffer the X server is done with, preferably the least recently
+// used one. Only wait if all of them are still in flight.
+static int get_free_buffer(struct vo *vo)
+{
+    struct priv *p = vo->priv;
+
+    vo_x11_check_events(vo);
+    for (int n = 1; n <= p->num_buffers; n++) {
+        int buf = (p->current_buf + n) % p->num_buffers;
+        if (!buffer_busy(vo, buf))
+            return buf;
+    }
+    // All buffers are in flight. Once the oldest put completes, the buffer
+    // after the last one is free again.
+    wait_for_completion(vo, p->num_buffers - 1);
+    return (p->current_buf + 1) % p->num_buffers;
+}
+
 static void flip_page(struct vo *vo)
 {
     struct priv *p = vo->priv;
     Display_Image(p, p->myximage[p->current_buf]);
-    p->current_buf = (p->current_buf + 1) % 2;
     if (vo->x11->use_present) {
         vo_x11_present(vo);
         present_sync_swap(vo->x11->present);
@@ -331,11 +370,11 @@ static bool draw_frame(struct vo *vo, struct vo_frame *frame)
 {
     struct priv *p = vo->priv;
 
-    wait_for_completion(vo, 1);
     bool render = vo_x11_check_visible(vo);
     if (!render)
         return VO_FALSE;
 
+    p->current_buf = get_free_buffer(vo);
     struct mp_image *img = &p->mp_ximages[p->current_buf];
 
     if (frame->current) {
@@ -374,10 +413,12 @@ static int query_format(struct vo *vo, int format)
 static void uninit(struct vo *vo)
 {
     struct priv *p = vo->priv;
-    if (p->myximage[0])
-        freeMyXImage(p, 0);
-    if (p->myximage[1])
-        freeMyXImage(p, 1);
+    if (vo->x11)
+        wait_for_completion(vo, 0);
+    for (int i = 0; i < p->num_buffers; i++) {
+        if (p->myximage[i])
+            freeMyXImage(p, i);
+    }
     if (p->gc)
         XFreeGC(vo->x11->display, p->gc);
 
@@ -388,6 +429,7 @@ static int preinit(struct vo *vo)
 {
     struct priv *p = vo->priv;
     p->vo = vo;
+    p->num_buffers = MPCLAMP(vo->opts->swapchain_depth + 1, 2, MAX_BUFFERS);
     p->sws = mp_sws_alloc(vo);
     p->sws->log = vo->log;
     mp_sws_enable_cmdline_opts(p->sws, vo->global);
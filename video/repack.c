@@ -16,17 +16,30 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include <libavutil/bswap.h>
 #include <libavutil/pixfmt.h>
 
 #include "common/common.h"
+#include "config.h"
+#include "osdep/endian.h"
 #include "repack.h"
 #include "video/csputils.h"
 #include "video/fmt-conversion.h"
 #include "video/img_format.h"
 #include "video/mp_image.h"
 
+// __builtin_convertvector() is required by the vector code.
+#if HAVE_VECTOR && BYTE_ORDER == LITTLE_ENDIAN && defined(__has_builtin)
+#if __has_builtin(__builtin_convertvector)
+#define REPACK_VECTOR 1
+#endif
+#endif
+#ifndef REPACK_VECTOR
+#define REPACK_VECTOR 0
+#endif
+
 enum repack_step_type {
     REPACK_STEP_FLOAT,
     REPACK_STEP_REPACK,
@@ -296,6 +309,205 @@ PA_SEQ_3(pa_ccc8,  uint8_t)
 UN_SEQ_3(un_ccc16, uint16_t)
 PA_SEQ_3(pa_ccc16, uint16_t)
 
+#if REPACK_VECTOR
+
+// Vector versions of some of the scanline functions above, using GCC vector
+// extensions. They process a fixed number of pixels per iteration, and leave
+// the remaining pixels to the scalar function. Unaligned loads/stores are done
+// with memcpy(). Like the scalar word access code, they assume little endian.
+
+typedef uint8_t  v8u8   __attribute__((vector_size(8)));
+typedef uint8_t  v16u8  __attribute__((vector_size(16)));
+typedef uint16_t v8u16  __attribute__((vector_size(16)));
+typedef uint16_t v16u16 __attribute__((vector_size(32)));
+typedef uint32_t v8u32  __attribute__((vector_size(32)));
+typedef int32_t  v8i32  __attribute__((vector_size(32)));
+typedef float    v8f32  __attribute__((vector_size(32)));
+
+union v32 {
+    v16u16 w;
+    v8u32 d;
+    v16u8 b[2];
+    v8u16 h[2];
+};
+
+// Split 16 bit words into low and high bytes, and the inverse.
+#define UN_BYTES(v, lo, hi) do {                                            \
+        (lo) = __builtin_convertvector((v) & 0xFF, v16u8);                  \
+        (hi) = __builtin_convertvector((v) >> 8, v16u8);                    \
+    } while (0)
+#define PA_BYTES(lo, hi)                                                    \
+    (__builtin_convertvector(lo, v16u16) |                                  \
+     (__builtin_convertvector(hi, v16u16) << 8))
+
+// Split 32 bit words into low and high 16 bit halves, and the inverse.
+#define UN_WORDS(v, lo, hi) do {                                            \
+        (lo) = __builtin_convertvector((v) & 0xFFFF, v8u16);                \
+        (hi) = __builtin_convertvector((v) >> 16, v8u16);                   \
+    } while (0)
+#define PA_WORDS(lo, hi)                                                    \
+    (__builtin_convertvector(lo, v8u32) |                                   \
+     (__builtin_convertvector(hi, v8u32) << 16))
+
+// Run the scalar scanline function on pixels [x, w).
+static void repack_tail(void (*fn)(void *restrict a, void *restrict b[], int w),
+                        void *restrict a, void *restrict b[], int num_b,
+                        int a_size, int b_size, int x, int w)
+{
+    if (x >= w)
+        return;
+    void *pb[4];
+    for (int n = 0; n < num_b; n++)
+        pb[n] = (uint8_t *)b[n] + x * b_size;
+    fn((uint8_t *)a + x * a_size, pb, w - x);
+}
+
+// 16 pixels with 4 8 bit components each.
+static inline void un_4x8(uint8_t *src, v16u8 c[4])
+{
+    v16u16 p0, p1;
+    memcpy(&p0, src, 32);
+    memcpy(&p1, src + 32, 32);
+    union v32 e, o;
+    UN_BYTES(p0, e.b[0], o.b[0]);
+    UN_BYTES(p1, e.b[1], o.b[1]);
+    UN_BYTES(e.w, c[0], c[2]);
+    UN_BYTES(o.w, c[1], c[3]);
+}
+
+static inline void pa_4x8(uint8_t *dst, v16u8 c[4])
+{
+    union v32 e = {.w = PA_BYTES(c[0], c[2])};
+    union v32 o = {.w = PA_BYTES(c[1], c[3])};
+    v16u16 p0 = PA_BYTES(e.b[0], o.b[0]);
+    v16u16 p1 = PA_BYTES(e.b[1], o.b[1]);
+    memcpy(dst, &p0, 32);
+    memcpy(dst + 32, &p1, 32);
+}
+
+// 8 pixels with 4 16 bit components each.
+static inline void un_4x16(uint16_t *src, v8u16 c[4])
+{
+    v8u32 p0, p1;
+    memcpy(&p0, src, 32);
+    memcpy(&p1, src + 16, 32);
+    union v32 e, o;
+    UN_WORDS(p0, e.h[0], o.h[0]);
+    UN_WORDS(p1, e.h[1], o.h[1]);
+    UN_WORDS(e.d, c[0], c[2]);
+    UN_WORDS(o.d, c[1], c[3]);
+}
+
+// Components c[first] to c[first + num - 1] map to the planes; the others
+// are ignored (unpacking) or set to 0 (packing).
+#define UN_VEC_4X8(name, scalar, first, num)                                \
+    static void name(void *restrict src, void *restrict dst[], int w) {     \
+        int x = 0;                                                          \
+        for (; x + 16 <= w; x += 16) {                                      \
+            v16u8 c[4];                                                     \
+            un_4x8((uint8_t *)src + x * 4, c);                              \
+            for (int n = 0; n < (num); n++)                                 \
+                memcpy((uint8_t *)dst[n] + x, &c[(first) + n], 16);         \
+        }                                                                   \
+        repack_tail(scalar, src, dst, num, 4, 1, x, w);                     \
+    }
+
+#define PA_VEC_4X8(name, scalar, first, num)                                \
+    static void name(void *restrict dst, void *restrict src[], int w) {     \
+        int x = 0;                                                          \
+        for (; x + 16 <= w; x += 16) {                                      \
+            v16u8 c[4] = {0};                                               \
+            for (int n = 0; n < (num); n++)                                 \
+                memcpy(&c[(first) + n], (uint8_t *)src[n] + x, 16);         \
+            pa_4x8((uint8_t *)dst + x * 4, c);                              \
+        }                                                                   \
+        repack_tail(scalar, dst, src, num, 4, 1, x, w);                     \
+    }
+
+#define UN_VEC_4X16(name, scalar, num)                                      \
+    static void name(void *restrict src, void *restrict dst[], int w) {     \
+        int x = 0;                                                          \
+        for (; x + 8 <= w; x += 8) {                                        \
+            v8u16 c[4];                                                     \
+            un_4x16((uint16_t *)src + x * 4, c);                            \
+            for (int n = 0; n < (num); n++)                                 \
+                memcpy((uint16_t *)dst[n] + x, &c[n], 16);                  \
+        }                                                                   \
+        repack_tail(scalar, src, dst, num, 8, 2, x, w);                     \
+    }
+
+UN_VEC_4X8(un_cccc8_vec,  un_cccc8,  0, 4)
+PA_VEC_4X8(pa_cccc8_vec,  pa_cccc8,  0, 4)
+UN_VEC_4X8(un_ccc8x8_vec, un_ccc8x8, 0, 3)
+PA_VEC_4X8(pa_ccc8z8_vec, pa_ccc8z8, 0, 3)
+UN_VEC_4X8(un_x8ccc8_vec, un_x8ccc8, 1, 3)
+PA_VEC_4X8(pa_z8ccc8_vec, pa_z8ccc8, 1, 3)
+// Packing 16 bit components is not faster than the scalar code.
+UN_VEC_4X16(un_cccc16_vec,   un_cccc16,   4)
+UN_VEC_4X16(un_ccc16x16_vec, un_ccc16x16, 3)
+
+static void un_cc8_vec(void *restrict src, void *restrict dst[], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        v16u16 p;
+        v16u8 c0, c1;
+        memcpy(&p, (uint8_t *)src + x * 2, 32);
+        UN_BYTES(p, c0, c1);
+        memcpy((uint8_t *)dst[0] + x, &c0, 16);
+        memcpy((uint8_t *)dst[1] + x, &c1, 16);
+    }
+    repack_tail(un_cc8, src, dst, 2, 2, 1, x, w);
+}
+
+static void pa_cc8_vec(void *restrict dst, void *restrict src[], int w)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        v16u8 c0, c1;
+        memcpy(&c0, (uint8_t *)src[0] + x, 16);
+        memcpy(&c1, (uint8_t *)src[1] + x, 16);
+        v16u16 p = PA_BYTES(c0, c1);
+        memcpy((uint8_t *)dst + x * 2, &p, 32);
+    }
+    repack_tail(pa_cc8, dst, src, 2, 2, 1, x, w);
+}
+
+static void un_cc16_vec(void *restrict src, void *restrict dst[], int w)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        v8u32 p;
+        v8u16 c0, c1;
+        memcpy(&p, (uint16_t *)src + x * 2, 32);
+        UN_WORDS(p, c0, c1);
+        memcpy((uint16_t *)dst[0] + x, &c0, 16);
+        memcpy((uint16_t *)dst[1] + x, &c1, 16);
+    }
+    repack_tail(un_cc16, src, dst, 2, 4, 2, x, w);
+}
+
+static void pa_cc16_vec(void *restrict dst, void *restrict src[], int w)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        v8u16 c0, c1;
+        memcpy(&c0, (uint16_t *)src[0] + x, 16);
+        memcpy(&c1, (uint16_t *)src[1] + x, 16);
+        v8u32 p = PA_WORDS(c0, c1);
+        memcpy((uint16_t *)dst + x * 2, &p, 32);
+    }
+    repack_tail(pa_cc16, dst, src, 2, 4, 2, x, w);
+}
+
+#define REPACK_VEC(name) name ## _vec
+
+#else
+
+#define REPACK_VEC(name) name
+
+#endif
+
 // "regular": single packed plane, all components have same width (except padding)
 struct regular_repacker {
     int packed_width;       // number of bits of the packed pixel
@@ -307,16 +519,16 @@ struct regular_repacker {
 };
 
 static const struct regular_repacker regular_repackers[] = {
-    {32, 8,  0, 3, pa_ccc8z8,   un_ccc8x8},
-    {32, 8,  8, 3, pa_z8ccc8,   un_x8ccc8},
-    {32, 8,  0, 4, pa_cccc8,    un_cccc8},
-    {64, 16, 0, 4, pa_cccc16,   un_cccc16},
-    {64, 16, 0, 3, pa_ccc16z16, un_ccc16x16},
-    {24, 8,  0, 3, pa_ccc8,     un_ccc8},
-    {48, 16, 0, 3, pa_ccc16,    un_ccc16},
-    {16, 8,  0, 2, pa_cc8,      un_cc8},
-    {32, 16, 0, 2, pa_cc16,     un_cc16},
-    {32, 10, 0, 3, pa_ccc10z2,  un_ccc10x2},
+    {32, 8,  0, 3, REPACK_VEC(pa_ccc8z8), REPACK_VEC(un_ccc8x8)},
+    {32, 8,  8, 3, REPACK_VEC(pa_z8ccc8), REPACK_VEC(un_x8ccc8)},
+    {32, 8,  0, 4, REPACK_VEC(pa_cccc8),  REPACK_VEC(un_cccc8)},
+    {64, 16, 0, 4, pa_cccc16,             REPACK_VEC(un_cccc16)},
+    {64, 16, 0, 3, pa_ccc16z16,           REPACK_VEC(un_ccc16x16)},
+    {24, 8,  0, 3, pa_ccc8,               un_ccc8},
+    {48, 16, 0, 3, pa_ccc16,              un_ccc16},
+    {16, 8,  0, 2, REPACK_VEC(pa_cc8),    REPACK_VEC(un_cc8)},
+    {32, 16, 0, 2, REPACK_VEC(pa_cc16),   REPACK_VEC(un_cc16)},
+    {32, 10, 0, 3, pa_ccc10z2,            un_ccc10x2},
 };
 
 static void packed_repack(struct mp_repack *rp,
@@ -814,6 +1026,85 @@ UN_F32(un_f32_8, uint8_t)
 PA_F32(pa_f32_16, uint16_t)
 UN_F32(un_f32_16, uint16_t)
 
+#if REPACK_VECTOR
+
+// Same as MPCLAMP(lrint(v), 0, p_max) with the default rounding mode (ties to
+// even), for 8 pixels. NaN becomes 0.
+static inline void pa_f32_round(v8i32 *res, float *restrict src, float m,
+                                float o, uint32_t p_max)
+{
+    v8f32 f;
+    memcpy(&f, src, 32);
+    f = (f + o) * m;
+    f = (v8f32)((v8i32)f & (f >= 0.0f));
+    v8i32 hi = f > (float)p_max;
+    v8f32 vmax = (v8f32){0} + (float)p_max;
+    f = (v8f32)(((v8i32)f & ~hi) | ((v8i32)vmax & hi));
+    // Adding and subtracting 1.5*2^23 rounds away the fraction bits.
+    f = (f + 0x1.8p23f) - 0x1.8p23f;
+    *res = __builtin_convertvector(f, v8i32);
+}
+
+static void pa_f32_8_vec(void *restrict dst, float *restrict src, int w,
+                         float m, float o, uint32_t p_max)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        v8i32 r;
+        pa_f32_round(&r, src + x, m, o, p_max);
+        v8u8 p = __builtin_convertvector(r, v8u8);
+        memcpy((uint8_t *)dst + x, &p, 8);
+    }
+    pa_f32_8((uint8_t *)dst + x, src + x, w - x, m, o, p_max);
+}
+
+static void pa_f32_16_vec(void *restrict dst, float *restrict src, int w,
+                          float m, float o, uint32_t p_max)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        v8i32 r;
+        pa_f32_round(&r, src + x, m, o, p_max);
+        v8u16 p = __builtin_convertvector(r, v8u16);
+        memcpy((uint16_t *)dst + x, &p, 16);
+    }
+    pa_f32_16((uint16_t *)dst + x, src + x, w - x, m, o, p_max);
+}
+
+// Widening in steps is much faster than converting to float directly.
+static void un_f32_8_vec(void *restrict src, float *restrict dst, int w,
+                         float m, float o, uint32_t unused)
+{
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        v16u8 s;
+        memcpy(&s, (uint8_t *)src + x, 16);
+        union v32 u = {.w = __builtin_convertvector(s, v16u16)};
+        for (int n = 0; n < 2; n++) {
+            v8i32 i = __builtin_convertvector(u.h[n], v8i32);
+            v8f32 f = __builtin_convertvector(i, v8f32) * m + o;
+            memcpy(dst + x + n * 8, &f, 32);
+        }
+    }
+    un_f32_8((uint8_t *)src + x, dst + x, w - x, m, o, unused);
+}
+
+static void un_f32_16_vec(void *restrict src, float *restrict dst, int w,
+                          float m, float o, uint32_t unused)
+{
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        v8u16 s;
+        memcpy(&s, (uint16_t *)src + x, 16);
+        v8i32 i = __builtin_convertvector(s, v8i32);
+        v8f32 f = __builtin_convertvector(i, v8f32) * m + o;
+        memcpy(dst + x, &f, 32);
+    }
+    un_f32_16((uint16_t *)src + x, dst + x, w - x, m, o, unused);
+}
+
+#endif
+
 // In all this, float counts as "unpacked".
 static void repack_float(struct mp_repack *rp,
                          struct mp_image *a, int a_x, int a_y,
@@ -822,8 +1113,10 @@ static void repack_float(struct mp_repack *rp,
     mp_assert(rp->f32_comp_size == 1 || rp->f32_comp_size == 2);
 
     void (*packer)(void *restrict a, float *restrict b, int w, float fm, float fb, uint32_t max)
-        = rp->pack ? (rp->f32_comp_size == 1 ? pa_f32_8 : pa_f32_16)
-                   : (rp->f32_comp_size == 1 ? un_f32_8 : un_f32_16);
+        = rp->pack ? (rp->f32_comp_size == 1 ? REPACK_VEC(pa_f32_8)
+                                             : REPACK_VEC(pa_f32_16))
+                   : (rp->f32_comp_size == 1 ? REPACK_VEC(un_f32_8)
+                                             : REPACK_VEC(un_f32_16));
 
     for (int p = 0; p < b->num_planes; p++) {
         int h = (1 << b->fmt.chroma_ys) - (1 << b->fmt.ys[p]) + 1;
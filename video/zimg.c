@@ -23,7 +23,7 @@
 #include "common/msg.h"
 #include "csputils.h"
 #include "misc/thread_pool.h"
-#include "misc/thread_tools.h"
+#include "osdep/threads.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "repack.h"
@@ -32,6 +32,43 @@
 #include "zimg.h"
 #include "config.h"
 
+// Don't split conversions into slices smaller than this (in destination
+// pixels); waking up a pool thread would cost more than it saves.
+#define MIN_SLICE_PIXELS (64 * 1024)
+
+// All zimg contexts share one pool, so several concurrent conversions (VO,
+// screenshots, filters) can't use more threads than there are CPUs.
+static mp_static_mutex shared_pool_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct mp_thread_pool *shared_pool;
+static int shared_pool_refs;
+
+static void ref_shared_pool(struct mp_zimg_context *ctx)
+{
+    if (ctx->pool_ref)
+        return;
+    mp_mutex_lock(&shared_pool_lock);
+    if (!shared_pool) {
+        int threads = MPCLAMP(av_cpu_count() - 1, 1, 63);
+        MP_VERBOSE(ctx, "using up to %d threads for scaling\n", threads);
+        shared_pool = mp_thread_pool_create(NULL, 0, 0, threads);
+    }
+    shared_pool_refs++;
+    mp_mutex_unlock(&shared_pool_lock);
+    ctx->pool_ref = true;
+}
+
+static void unref_shared_pool(struct mp_zimg_context *ctx)
+{
+    if (!ctx->pool_ref)
+        return;
+    mp_mutex_lock(&shared_pool_lock);
+    mp_assert(shared_pool_refs > 0);
+    if (--shared_pool_refs == 0)
+        TA_FREEP(&shared_pool);
+    mp_mutex_unlock(&shared_pool_lock);
+    ctx->pool_ref = false;
+}
+
 static_assert(MP_IMAGE_BYTE_ALIGN >= ZIMG_ALIGN, "");
 
 #define HAVE_ZIMG_ALPHA (ZIMG_API_VERSION >= ZIMG_MAKE_API_VERSION(2, 4))
@@ -87,7 +124,19 @@ struct mp_zimg_state {
     struct mp_zimg_repack *dst;
     int slice_y, slice_h; // y start position, height of target slice
     double scale_y;
-    struct mp_waiter thread_waiter;
+};
+
+// One mp_zimg_convert() call. Slices are claimed in order by whichever thread
+// gets to them first (the caller included), so a pool thread which wakes up
+// late simply finds nothing left to do. Freed by whoever drops the last ref.
+struct zimg_job {
+    mp_mutex lock;
+    mp_cond wakeup;
+    struct mp_zimg_state **states;
+    int num_states;
+    int next;       // next slice to claim
+    int done;       // number of finished slices
+    int refs;       // caller + queued pool items
 };
 
 struct mp_zimg_repack {
@@ -216,7 +265,7 @@ static void free_mp_zimg(void *p)
     struct mp_zimg_context *ctx = p;
 
     destroy_zimg(ctx);
-    TA_FREEP(&ctx->tp);
+    unref_shared_pool(ctx);
 }
 
 struct mp_zimg_context *mp_zimg_alloc(void)
@@ -595,24 +644,15 @@ bool mp_zimg_config(struct mp_zimg_context *ctx)
     if (!dstfmt.align_y)
         goto fail;
     int full_h = MP_ALIGN_UP(ctx->dst.h, dstfmt.align_y);
+    int64_t pixels = (int64_t)MPMAX(ctx->dst.w, 1) * full_h;
+    slices = MPCLAMP(pixels / MIN_SLICE_PIXELS, 1, slices);
     int slice_h = (full_h + slices - 1) / slices;
     slice_h = MP_ALIGN_UP(slice_h, dstfmt.align_y);
     slice_h = MP_ALIGN_UP(slice_h, 64); // for dithering and minimum slice size
     slices = (full_h + slice_h - 1) / slice_h;
 
-    int threads = slices - 1;
-    if (threads != ctx->current_thread_count) {
-        // Just destroy and recreate all - dumb and costly, but rarely happens.
-        TA_FREEP(&ctx->tp);
-        ctx->current_thread_count = 0;
-        if (threads) {
-            MP_VERBOSE(ctx, "using %d threads for scaling\n", threads);
-            ctx->tp = mp_thread_pool_create(NULL, threads, threads, threads);
-            if (!ctx->tp)
-                goto fail;
-            ctx->current_thread_count = threads;
-        }
-    }
+    if (slices > 1)
+        ref_shared_pool(ctx);
 
     for (int n = 0; n < slices; n++) {
         struct mp_zimg_state *st = talloc_zero(NULL, struct mp_zimg_state);
@@ -665,12 +705,41 @@ static void do_convert(struct mp_zimg_state *st)
                               repack_entrypoint, st->dst);
 }
 
+static void unref_job(struct zimg_job *job)
+{
+    mp_mutex_lock(&job->lock);
+    bool last = --job->refs == 0;
+    mp_mutex_unlock(&job->lock);
+    if (last) {
+        mp_mutex_destroy(&job->lock);
+        mp_cond_destroy(&job->wakeup);
+        talloc_free(job);
+    }
+}
+
+// Convert slices until none are left to claim.
+static void run_job(struct zimg_job *job)
+{
+    mp_mutex_lock(&job->lock);
+    while (job->next < job->num_states) {
+        struct mp_zimg_state *st = job->states[job->next++];
+        mp_mutex_unlock(&job->lock);
+
+        do_convert(st);
+
+        mp_mutex_lock(&job->lock);
+        if (++job->done == job->num_states)
+            mp_cond_broadcast(&job->wakeup);
+    }
+    mp_mutex_unlock(&job->lock);
+}
+
 static void do_convert_thread(void *ptr)
 {
-    struct mp_zimg_state *st = ptr;
+    struct zimg_job *job = ptr;
 
-    do_convert(st);
-    mp_waiter_wakeup(&st->thread_waiter, 0);
+    run_job(job);
+    unref_job(job);
 }
 
 bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
@@ -693,23 +762,43 @@ bool mp_zimg_convert(struct mp_zimg_context *ctx, struct mp_image *dst,
         }
     }
 
-    for (int n = 1; n < ctx->num_states; n++) {
-        struct mp_zimg_state *st = ctx->states[n];
+    if (ctx->num_states == 1) {
+        do_convert(ctx->states[0]);
+        return true;
+    }
 
-        st->thread_waiter = (struct mp_waiter)MP_WAITER_INITIALIZER;
+    struct zimg_job *job = talloc_ptrtype(NULL, job);
+    *job = (struct zimg_job){
+        .states = ctx->states,
+        .num_states = ctx->num_states,
+        .refs = 1,
+    };
+    mp_mutex_init(&job->lock);
+    mp_cond_init(&job->wakeup);
 
-        bool r = mp_thread_pool_run(ctx->tp, do_convert_thread, st);
-        // This is guaranteed by the API; and unrolling would be inconvenient.
-        mp_assert(r);
+    // Only hand out work to threads which are free right now; whatever they
+    // don't pick up is done by the caller.
+    for (int n = 1; n < ctx->num_states; n++) {
+        mp_mutex_lock(&job->lock);
+        job->refs++;
+        mp_mutex_unlock(&job->lock);
+        if (!mp_thread_pool_run(shared_pool, do_convert_thread, job)) {
+            mp_mutex_lock(&job->lock);
+            job->refs--;
+            mp_mutex_unlock(&job->lock);
+            break;
+        }
     }
 
-    do_convert(ctx->states[0]);
+    run_job(job);
 
-    for (int n = 1; n < ctx->num_states; n++) {
-        struct mp_zimg_state *st = ctx->states[n];
+    // Wait only for slices which were claimed by other threads.
+    mp_mutex_lock(&job->lock);
+    while (job->done < job->num_states)
+        mp_cond_wait(&job->wakeup, &job->lock);
+    mp_mutex_unlock(&job->lock);
 
-        mp_waiter_wait(&st->thread_waiter);
-    }
+    unref_job(job);
 
     return true;
 }